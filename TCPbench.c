@@ -0,0 +1,132 @@
+/**	@file TCPbench.c
+ * 	@brief Contains the function implementations for writing, reading and comparing the
+ *	results of the benchmark programs.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+#include "TCPbench.h"
+
+/*
+ **************************************************
+ *		COMPILER PRE DEFINES
+ **************************************************
+ */
+
+#define BENCH_RESULT_FORMAT "{\"name\":\"%s\",\"ns_per_op\":%.1f,\"ops_per_sec\":%.1f,\"bytes_per_op\":%.1f,\"allocs_per_op\":%.3f,\"p50_us\":%.1f,\"p99_us\":%.1f}\n"
+#define BENCH_RESULT_SCAN "{\"name\":\"%63[^\"]\",\"ns_per_op\":%lf,\"ops_per_sec\":%lf,\"bytes_per_op\":%lf,\"allocs_per_op\":%lf,\"p50_us\":%lf,\"p99_us\":%lf}"
+
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Works out how much a value changed in percent.
+*	@param 	before is the baseline value and after the current one.
+*	@return returns the change in percent, or 0 if there is no baseline value.
+*/
+double bench_Change(double before, double after);
+
+
+/*
+ **************************************************
+ *		BENCHMARK RESULT FUNCTIONS
+ **************************************************
+ */
+
+/*
+ **************************************************
+ **************************************************
+ */
+void write_Bench_Result(FILE *output, BenchResult_P result){
+  fprintf(output, BENCH_RESULT_FORMAT, result->name, result->nsPerOp, result->opsPerSec,
+	result->bytesPerOp, result->allocsPerOp, result->p50Us, result->p99Us);
+  fflush(output);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int read_Bench_Results(char *path, BenchResult_P results, int max){
+  char line[512];
+  int count = 0;
+  FILE *input = fopen(path, "r");
+  if(input == NULL) return -1;
+  while(count < max && fgets(line, sizeof(line), input) != NULL)
+  {
+	if(sscanf(line, BENCH_RESULT_SCAN, results[count].name, &results[count].nsPerOp, &results[count].opsPerSec,
+		&results[count].bytesPerOp, &results[count].allocsPerOp, &results[count].p50Us, &results[count].p99Us) == 7)
+		count++;
+  }
+  fclose(input);
+  return count;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int compare_Bench_Results(BenchResult_P baseline, int baselineCount, BenchResult_P current, int currentCount, double threshold){
+  BenchResult_P before = NULL, after = NULL;
+  double time = 0.0, rate = 0.0, tail = 0.0;	//changes in percent
+  int regressions = 0, regressed = 0, missing = 0, i = 0, j = 0;
+
+  printf("%-32s %10s %10s %10s %8s\n", "benchmark", "ns/op", "ops/s", "p99", "allocs");
+  for(i = 0; i < currentCount; i++)
+  {
+	after = &current[i];
+	for(j = 0, before = NULL; j < baselineCount && before == NULL; j++)
+		if(!strcmp(baseline[j].name, after->name)) before = &baseline[j];
+	if(before == NULL)
+	{
+		printf("%-32s %10s\n", after->name, "new");
+		continue;
+	}
+	time = bench_Change(before->nsPerOp, after->nsPerOp);
+	rate = bench_Change(before->opsPerSec, after->opsPerSec);
+	tail = bench_Change(before->p99Us, after->p99Us);
+	regressed = (time > threshold || rate < -threshold || after->allocsPerOp > before->allocsPerOp + 0.001);
+	regressions += regressed;
+	printf("%-32s %+9.1f%% %+9.1f%% %+9.1f%% %+8.3f%s\n", after->name, time, rate, tail,
+		after->allocsPerOp - before->allocsPerOp, regressed ? "  REGRESSION" : "");
+  }
+  //a benchmark that no longer runs, or failed to, cannot show it did not regress
+  for(i = 0; i < baselineCount; i++)
+  {
+	for(j = 0, after = NULL; j < currentCount && after == NULL; j++)
+		if(!strcmp(current[j].name, baseline[i].name)) after = &current[j];
+	if(after != NULL) continue;
+	printf("%-32s %10s  REGRESSION\n", baseline[i].name, "missing");
+	missing++;
+  }
+  regressions += missing;
+  printf("%d of %d benchmarks regressed by more than %.1f%%\n", regressions, currentCount + missing, threshold);
+  return regressions;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+double bench_Change(double before, double after){
+  if(before <= 0.0) return 0.0;
+  return (after - before) * 100.0 / before;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+uint64_t bench_Clock(void){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * BENCH_NANOSECONDS + now.tv_nsec;
+}
@@ -0,0 +1,96 @@
+/**	@file TCPbench.h
+ * 	@brief Contains the function prototypes shared by the benchmark programs for writing,
+ *	reading and comparing their results, implemented in TCPbench.c
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+/*
+ * TCPbench.h
+ *
+ * Every benchmark result is one JSON object on a line of its own, so the results of several
+ * benchmark programs can be written to the same file one after the other:
+ *
+ *	{"name":"modify/echo-short","ns_per_op":85.2,"ops_per_sec":11737089.2,"bytes_per_op":41.0,
+ *	 "allocs_per_op":0.000,"p50_us":0.0,"p99_us":0.0}
+ *
+ * Handler benchmarks fill in ns_per_op, ops_per_sec, bytes_per_op and allocs_per_op; loopback
+ * benchmarks fill in ops_per_sec and the latency percentiles. A field that does not apply is 0.
+ *
+ * Two result files are compared by name. A result regresses when its ns_per_op grows, or its
+ * ops_per_sec shrinks, by more than the threshold, or when it allocates more. The change of
+ * p99_us is printed too, but tail latency on a shared host is too noisy to fail on.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ **************************************************
+ *		COMPILER PRE DEFINES
+ **************************************************
+ */
+
+#define BENCH_NAME_MAX 64
+#define BENCH_MAX_RESULTS 256
+#define BENCH_THRESHOLD 15.0
+#define BENCH_NANOSECONDS 1000000000ULL
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	The result of one benchmark
+ */
+typedef struct BenchResult{
+  char name[BENCH_NAME_MAX];
+  double nsPerOp;
+  double opsPerSec;
+  double bytesPerOp;	//bytes of request read and reply written per request
+  double allocsPerOp;	//heap allocations per request
+  double p50Us;	//median latency in microseconds
+  double p99Us;
+}BenchResult_T, *BenchResult_P;
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Writes a result as one line of JSON.
+*	@param 	*output is the file the result is written to.
+*			result is the result.
+*	@return returns nothing.
+*/
+void write_Bench_Result(FILE *output, BenchResult_P result);
+
+/**	@brief 	Reads the results written by write_Bench_Result; lines that are not results are skipped.
+*	@param 	*path is the result file.
+*			results is filled in with the results.
+*			max is the number of results that fit.
+*	@return returns the number of results read, or -1 if the file cannot be opened.
+*/
+int read_Bench_Results(char *path, BenchResult_P results, int max);
+
+/**	@brief 	Prints how every current result changed against the baseline result of the same name.
+*			A baseline result with no current result counts as a regression.
+*	@param 	baseline and baselineCount are the stored results.
+*			current and currentCount are the new results.
+*			threshold is the change in percent allowed before a result counts as a regression.
+*	@return returns the number of regressions.
+*/
+int compare_Bench_Results(BenchResult_P baseline, int baselineCount, BenchResult_P current, int currentCount, double threshold);
+
+/**	@brief 	Reads the monotonic clock.
+*	@param 	no parameter is passed.
+*	@return returns the time in nanoseconds.
+*/
+uint64_t bench_Clock(void);
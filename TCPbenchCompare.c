@@ -0,0 +1,38 @@
+/**	@file TCPbenchCompare.c
+ * 	@brief Contains the main program for comparing benchmark results against a stored baseline.
+ *	Prints the change of every benchmark and fails when any of them regressed.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+#include "TCPbench.h"
+
+/**	@brief 	The main program for comparing benchmark results.
+*	@param 	argv[1] is the baseline result file and argv[2] the current one. The optional
+*			argv[3] is the change in percent allowed, BENCH_THRESHOLD by default.
+*	@return returns 0 to the OS if nothing regressed, 1 otherwise.
+*/
+int main(int argc, char**argv)
+{
+	BenchResult_T baseline[BENCH_MAX_RESULTS], current[BENCH_MAX_RESULTS];
+	int baselineCount = 0, currentCount = 0;
+	double threshold = BENCH_THRESHOLD;
+
+	if(argc != 3 && argc != 4)
+	{
+		printf("Incorrect Number of Command Line Arguments\n");
+		printf("./bench_compare <Baseline Results> <Current Results> [Threshold in Percent]\n");
+		return 1;
+	}
+	if(argc == 4) threshold = atof(argv[3]);
+
+	baselineCount = read_Bench_Results(argv[1], baseline, BENCH_MAX_RESULTS);
+	currentCount = read_Bench_Results(argv[2], current, BENCH_MAX_RESULTS);
+	if(baselineCount == -1 || currentCount == -1)
+	{
+		fprintf(stderr, "ERROR: Cannot Read %s\n", (baselineCount == -1) ? argv[1] : argv[2]);
+		return 1;
+	}
+	return compare_Bench_Results(baseline, baselineCount, current, currentCount, threshold) > 0;
+}
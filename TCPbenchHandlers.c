@@ -0,0 +1,231 @@
+/**	@file TCPbenchHandlers.c
+ * 	@brief Contains the main program for the request handler microbenchmarks.
+ *	Runs modifyMessage, echoMessage, reverseString and nextRequestLength over corpora of
+ *	representative requests in the process itself, without sockets, and writes how long
+ *	each request takes, the bytes it moves and the heap allocations it makes as JSON lines
+ *	(see TCPbench.h). The program is linked with malloc, calloc and realloc wrapped, so
+ *	every allocation made by the server's code is counted.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+#include "TCPserver.h"
+#include "TCPbench.h"
+
+/*
+ **************************************************
+ *		COMPILER PRE DEFINES
+ **************************************************
+ */
+
+#define BENCH_RUNS 9
+#define BENCH_RUN_NS 30000000ULL
+#define BENCH_MODIFY 0
+#define BENCH_ECHO 1
+#define BENCH_REVERSE 2
+#define BENCH_FRAME 3
+#define BENCH_CORPUS_MAX 8
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	A benchmark: the handler it runs and the requests it runs it on, in turn
+ */
+typedef struct HandlerBench{
+  char *name;
+  int handler;
+  char *corpus[BENCH_CORPUS_MAX];	//NULL terminated
+}HandlerBench_T, *HandlerBench_P;
+
+static unsigned long allocations = 0;
+static volatile char sink;	//keeps the compiler from dropping the handlers' work
+
+static char longEcho[MAX_MESSAGE], longText[MAX_MESSAGE], pipelined[MAX_MESSAGE];
+
+static HandlerBench_T benches[] = {
+  { "modify/echo-short", BENCH_MODIFY, { "<echo>HelloWorld</echo>", NULL } },
+  { "modify/echo-long", BENCH_MODIFY, { longEcho, NULL } },
+  { "modify/echo-malformed", BENCH_MODIFY, { "<echo>HelloWorld", NULL } },
+  { "modify/loadavg", BENCH_MODIFY, { "<loadavg/>", NULL } },
+  { "modify/stats", BENCH_MODIFY, { "<stats/>", NULL } },
+  { "modify/error", BENCH_MODIFY, { "<hello>World</hello>", NULL } },
+  { "modify/mixed", BENCH_MODIFY, { "<echo>HelloWorld</echo>", "<echo>sfglk</echo>", longEcho, "<loadavg/>", "<echo></echo>", "<echo>Hello", NULL } },
+  { "echo/short", BENCH_ECHO, { "<echo>HelloWorld</echo>", NULL } },
+  { "echo/long", BENCH_ECHO, { longEcho, NULL } },
+  { "reverse/short", BENCH_REVERSE, { "HelloWorld", NULL } },
+  { "reverse/long", BENCH_REVERSE, { longText, NULL } },
+  { "frame/pipelined", BENCH_FRAME, { pipelined, NULL } },
+};
+
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Runs a benchmark until BENCH_RUN_NS have passed, BENCH_RUNS times, and keeps the
+*			fastest run, the one least disturbed by the rest of the host.
+*	@param 	bench is the benchmark.
+*			result is filled in with its result.
+*	@return returns nothing.
+*/
+void run_Handler_Bench(HandlerBench_P bench, BenchResult_P result);
+
+/**	@brief 	Handles one request of a benchmark's corpus.
+*	@param 	bench is the benchmark.
+*			*request is the request.
+*	@return returns the bytes of request read and reply written.
+*/
+int run_Handler(HandlerBench_P bench, char *request);
+
+/**	@brief 	Count the allocations of the server's code and then make them; the linker sends
+*			the server's calls of malloc, calloc and realloc here.
+*/
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *pointer, size_t size);
+
+
+/**	@brief 	The main program for the request handler microbenchmarks.
+*	@param 	no parameter is used.
+*	@return returns 0 to the OS when every benchmark has run.
+*/
+int main(int argc, char**argv)
+{
+	BenchResult_T result;
+	int i = 0, length = 0;
+
+	//the long requests come close to the largest request the server takes
+	strcpy(longEcho, "<echo>");
+	for(i = 0; i < 200; i++) longText[i] = 'a' + i % 26;
+	strcat(longEcho, longText);
+	strcat(longEcho, "</echo>");
+	//a buffer of requests pipelined the way clients send them
+	while(length + 32 < MAX_MESSAGE)
+		length += sprintf(pipelined + length, "%s", (length % 3) ? "<echo>pipelined</echo>\n" : "<loadavg/>\n");
+
+	fprintf(stderr, "%-24s %10s %10s %8s\n", "benchmark", "ns/op", "bytes/op", "allocs");
+	for(i = 0; i < (int) (sizeof(benches) / sizeof(benches[0])); i++)
+	{
+		run_Handler_Bench(&benches[i], &result);
+		write_Bench_Result(stdout, &result);
+		fprintf(stderr, "%-24s %10.1f %10.1f %8.3f\n", result.name, result.nsPerOp, result.bytesPerOp, result.allocsPerOp);
+	}
+	return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void run_Handler_Bench(HandlerBench_P bench, BenchResult_P result){
+  double fastest = 0.0, nsPerOp = 0.0;
+  uint64_t start = 0, elapsed = 0, iterations = 0, bytes = 0, batch = 0;
+  unsigned long allocated = 0;
+  int run = 0, next = 0;
+
+  memset((void *) result, 0, sizeof(BenchResult_T));
+  strncpy(result->name, bench->name, BENCH_NAME_MAX - 1);
+  for(run = 0; run < BENCH_RUNS; run++)
+  {
+	iterations = bytes = elapsed = 0;
+	allocated = allocations;
+	start = bench_Clock();
+	//read the clock only every batch so it costs next to nothing per request
+	while(elapsed < BENCH_RUN_NS)
+	{
+		for(batch = 0; batch < 256; batch++)
+		{
+			bytes += run_Handler(bench, bench->corpus[next]);
+			if(bench->corpus[++next] == NULL) next = 0;
+		}
+		iterations += batch;
+		elapsed = bench_Clock() - start;
+	}
+	nsPerOp = (double) elapsed / iterations;
+	if(run > 0 && nsPerOp >= fastest) continue;
+	//every figure of the result comes from the same run
+	fastest = nsPerOp;
+	result->bytesPerOp = (double) bytes / iterations;
+	result->allocsPerOp = (double) (allocations - allocated) / iterations;
+  }
+  result->nsPerOp = fastest;
+  result->opsPerSec = (result->nsPerOp > 0.0) ? BENCH_NANOSECONDS / result->nsPerOp : 0.0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int run_Handler(HandlerBench_P bench, char *request){
+  char sendMesg[MAX_REPLY], text[MAX_MESSAGE];
+  int length = 0, total = 0, next = 0;
+  switch(bench->handler)
+  {
+	case BENCH_MODIFY:
+		sendMesg[0] = '\0';
+		modifyMessage(request, sendMesg);
+		sink = sendMesg[0];
+		return strlen(request) + strlen(sendMesg);
+	case BENCH_ECHO:
+		sendMesg[0] = '\0';
+		echoMessage(request, sendMesg);
+		sink = sendMesg[0];
+		return strlen(request) + strlen(sendMesg);
+	case BENCH_REVERSE:
+		length = strlen(request);
+		memcpy(text, request, length + 1);
+		reverseString(text);
+		sink = text[0];
+		return 2 * length;
+	case BENCH_FRAME:
+		//one request here is the whole buffer, framed the way a worker takes its requests in turn
+		length = strlen(request);
+		while(total < length && (next = nextRequestLength(request + total, length - total, MORE_NONE)) > 0)
+			total += next;
+		sink = request[total];
+		return length;
+  }
+  return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void *__wrap_malloc(size_t size){
+  allocations++;
+  return __real_malloc(size);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void *__wrap_calloc(size_t count, size_t size){
+  allocations++;
+  return __real_calloc(count, size);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void *__wrap_realloc(void *pointer, size_t size){
+  allocations++;
+  return __real_realloc(pointer, size);
+}
@@ -0,0 +1,418 @@
+/**	@file TCPbenchLoopback.c
+ * 	@brief Contains the main program for the end to end loopback benchmark.
+ *	Starts the server on a fixed port of this host, unless a running server is given, and
+ *	drives it with the asynchronous client at several concurrency levels, keeping that many
+ *	requests outstanding at all times. Then measures how fast the server accepts new
+ *	connections. Writes the throughput and latency percentiles of every level as JSON lines
+ *	(see TCPbench.h) and stops the server with SIGTERM, so it exits normally.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+#include <signal.h>
+#include <sys/wait.h>
+#include "TCPclientAsync.h"
+#include "TCPbench.h"
+
+/*
+ **************************************************
+ *		COMPILER PRE DEFINES
+ **************************************************
+ */
+
+#define BENCH_PORT 7400
+#define BENCH_REQUESTS 200000
+#define BENCH_CONNECTS 5000
+#define BENCH_MAX_CONNECTIONS 32
+#define BENCH_START_MS 5000
+#define BENCH_MAX_PORT 65535
+#define MICROSECOND 1000.0
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	One concurrency level being driven
+ */
+typedef struct LoopbackRun{
+  AsyncClient_P client;
+  int server;
+  char **corpus;	//NULL terminated requests sent in turn
+  int next;
+  int remaining;	//requests still to be sent
+  uint64_t *latencies;	//nanoseconds per answered request
+  int completed;
+  int failed;
+}LoopbackRun_T, *LoopbackRun_P;
+
+/*
+ *	A request that is outstanding
+ */
+typedef struct LoopbackSlot{
+  LoopbackRun_P run;
+  uint64_t sentAt;
+}LoopbackSlot_T, *LoopbackSlot_P;
+
+static char *echoCorpus[] = { "<echo>HelloWorld</echo>", NULL };
+static char *mixedCorpus[] = { "<echo>HelloWorld</echo>", "<echo>sfglk</echo>", "<loadavg/>", "<echo>The quick brown fox jumps over the lazy dog</echo>", "<hello>World</hello>", NULL };
+
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Starts the server program on the port with its output discarded and waits until
+*			it takes connections.
+*	@param 	*program is the server program.
+*			port is the port it listens on.
+*			*workers is the number of worker threads given as a string, or NULL for the default.
+*	@return returns the server's process id, or -1 if it did not start.
+*/
+pid_t startServer(char *program, int port, char *workers);
+
+/**	@brief 	Reads a whole number option and checks its range.
+*	@param 	*text is the option's text.
+*			min and max are the smallest and largest value allowed.
+*			*value is set to the number.
+*	@return returns 0, or -1 if the text is not a number in the range.
+*/
+int parseOption(char *text, long min, long max, int *value);
+
+/**	@brief 	Keeps concurrency requests outstanding until requests have been answered.
+*	@param 	*serverName and port are the server.
+*			*name is the name of the result.
+*			**corpus are the requests, sent in turn.
+*			concurrency is the number of outstanding requests.
+*			requests is the number of requests.
+*			result is filled in with the throughput and latencies.
+*	@return returns the number of requests that failed, or -1 if the level could not run.
+*/
+int runLevel(char *serverName, int port, char *name, char **corpus, int concurrency, int requests, BenchResult_P result);
+
+/**	@brief 	Takes the response of an outstanding request and sends the next one in its place.
+*	@param 	*context is the request's LoopbackSlot.
+*			id, status and *response are those of the asynchronous client's callback.
+*	@return returns nothing.
+*/
+void levelResponse(void *context, int id, int status, char *response);
+
+/**	@brief 	Opens a connection, sends one request and closes it again, count times in a row.
+*	@param 	*serverName and port are the server.
+*			count is the number of connections.
+*			result is filled in with the connections per second and their latencies.
+*	@return returns the number of connections that failed.
+*/
+int runConnects(char *serverName, int port, int count, BenchResult_P result);
+
+/**	@brief 	Fills in the throughput and latency percentiles of a result.
+*	@param 	result is the result.
+*			*latencies are the latencies of every answered request, sorted by this function.
+*			count is the number of latencies.
+*			elapsed is how long the requests took in nanoseconds.
+*	@return returns nothing.
+*/
+void fillResult(BenchResult_P result, uint64_t *latencies, int count, uint64_t elapsed);
+
+/**	@brief 	Orders two latencies for qsort.
+*	@param 	*first and *second are the two latencies to compare.
+*	@return returns a negative number, zero or a positive number like strcmp.
+*/
+int compareLatencies(const void *first, const void *second);
+
+
+/**	@brief 	The main program for the loopback benchmark.
+*	@param 	-s <server program> is the server to start, ./server by default.
+*			-a <address> benchmarks a server that is already running there instead.
+*			-p <port> is the port of the server, BENCH_PORT by default.
+*			-w <workers> is the number of worker threads of the server started.
+*			-n <requests> is the number of requests per concurrency level.
+*	@return returns 0 to the OS if every request was answered, 1 otherwise.
+*/
+int main(int argc, char**argv)
+{
+	int levels[] = { 1, 8, 64, 256 };
+	char *program = "./server", *serverName = "127.0.0.1", *workers = NULL, name[BENCH_NAME_MAX];
+	int port = BENCH_PORT, requests = BENCH_REQUESTS, external = 0, failed = 0, result = 0, option = 0, i = 0;
+	pid_t server = -1;
+	BenchResult_T benchResult;
+
+	while((option = getopt(argc, argv, "s:a:p:w:n:")) != -1)
+	{
+		switch(option)
+		{
+			case 's': program = optarg; break;
+			case 'a': serverName = optarg; external = 1; break;
+			case 'p':
+				if(parseOption(optarg, 1, BENCH_MAX_PORT, &port) == -1)
+				{
+					fprintf(stderr, "ERROR: Port Must Be a Number From 1 to %d\n", BENCH_MAX_PORT);
+					return 1;
+				}
+				break;
+			case 'w': workers = optarg; break;
+			case 'n':
+				if(parseOption(optarg, 1, INT_MAX, &requests) == -1)
+				{
+					fprintf(stderr, "ERROR: Requests Must Be a Number From 1 to %d\n", INT_MAX);
+					return 1;
+				}
+				break;
+			default:
+				fprintf(stderr, "./bench_loopback [-s <Server Program> | -a <Running Server>] [-p <Port>] [-w <Workers>] [-n <Requests>]\n");
+				return 1;
+		}
+	}
+
+	if(!external)
+	{
+		server = startServer(program, port, workers);
+		if(server == -1)
+		{
+			fprintf(stderr, "ERROR: Cannot Start %s On Port %d\n", program, port);
+			return 1;
+		}
+	}
+
+	fprintf(stderr, "%-24s %12s %10s %10s\n", "benchmark", "requests/s", "p50 (us)", "p99 (us)");
+	for(i = 0; i <= (int) (sizeof(levels) / sizeof(levels[0])); i++)
+	{
+		//every level answers the same echo, and the busiest level also a mix of requests
+		if(i < (int) (sizeof(levels) / sizeof(levels[0])))
+		{
+			sprintf(name, "loopback/echo-c%d", levels[i]);
+			result = runLevel(serverName, port, name, echoCorpus, levels[i], requests, &benchResult);
+		}
+		else
+		{
+			sprintf(name, "loopback/mixed-c%d", levels[i - 1]);
+			result = runLevel(serverName, port, name, mixedCorpus, levels[i - 1], requests, &benchResult);
+		}
+		if(result == -1)
+		{
+			failed += requests;
+			continue;
+		}
+		failed += result;
+		write_Bench_Result(stdout, &benchResult);
+		fprintf(stderr, "%-24s %12.0f %10.1f %10.1f\n", benchResult.name, benchResult.opsPerSec, benchResult.p50Us, benchResult.p99Us);
+	}
+
+	failed += runConnects(serverName, port, BENCH_CONNECTS, &benchResult);
+	write_Bench_Result(stdout, &benchResult);
+	fprintf(stderr, "%-24s %12.0f %10.1f %10.1f\n", benchResult.name, benchResult.opsPerSec, benchResult.p50Us, benchResult.p99Us);
+
+	if(server != -1)
+	{
+		kill(server, SIGTERM);
+		waitpid(server, NULL, 0);
+	}
+	if(failed > 0)
+	{
+		fprintf(stderr, "ERROR: %d Requests Failed\n", failed);
+		return 1;
+	}
+	return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+pid_t startServer(char *program, int port, char *workers){
+  char portText[16], response[MAX_MESSAGE];
+  struct sockaddr_in address;
+  struct timeval wait = { 1, 0 };
+  uint64_t start = 0;
+  int sockfd = -1, null = -1, status = 0, received = 0, byteReceivedCount = 0;
+  pid_t server = fork();
+  if(server == -1) return -1;
+  if(server == 0)
+  {
+	//the server's banner would only get in the way of the results
+	null = open("/dev/null", O_WRONLY);
+	if(null != -1)
+	{
+		dup2(null, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+	}
+	sprintf(portText, "%d", port);
+	if(workers != NULL)
+		execl(program, program, "-q", "-p", portText, "-w", workers, (char *) NULL);
+	else
+		execl(program, program, "-q", "-p", portText, (char *) NULL);
+	_exit(127);
+  }
+
+  memset((void *) &address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons((u_short) port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for(start = bench_Clock(); bench_Clock() - start < BENCH_START_MS * 1000000ULL; usleep(20000))
+  {
+	if(waitpid(server, &status, WNOHANG) == server) return -1;
+	sockfd = socket(AF_INET, SOCK_STREAM, 0);
+	if(sockfd == -1) break;
+	setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
+	//the server is up once it answers a request, and the probe's connection is done with before it closes
+	received = status = 0;
+	if(connect(sockfd, (struct sockaddr *) &address, sizeof(address)) == 0 && send(sockfd, "<loadavg/>\n", 11, MSG_NOSIGNAL) == 11)
+		while(!status && (byteReceivedCount = recv(sockfd, response + received, sizeof(response) - received, 0)) > 0)
+		{
+			received += byteReceivedCount;
+			status = (responseLength(response, received) > 0);
+		}
+	close(sockfd);
+	if(status) return server;
+  }
+  kill(server, SIGKILL);
+  waitpid(server, NULL, 0);
+  return -1;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int parseOption(char *text, long min, long max, int *value){
+  char *end = NULL;
+  long number = 0;
+  errno = 0;
+  number = strtol(text, &end, 10);
+  if(errno != 0 || end == text || *end != '\0' || number < min || number > max) return -1;
+  *value = (int) number;
+  return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int runLevel(char *serverName, int port, char *name, char **corpus, int concurrency, int requests, BenchResult_P result){
+  LoopbackRun_T run;
+  LoopbackSlot_P slots = NULL;
+  uint64_t start = 0, elapsed = 0;
+  int connections = (concurrency < BENCH_MAX_CONNECTIONS) ? concurrency : BENCH_MAX_CONNECTIONS;
+  int i = 0, failed = -1;
+
+  memset((void *) &run, 0, sizeof(run));
+  memset((void *) result, 0, sizeof(BenchResult_T));
+  strncpy(result->name, name, BENCH_NAME_MAX - 1);
+  run.corpus = corpus;
+  run.remaining = requests;
+  run.server = -1;
+  run.client = createAsyncClient();
+  run.latencies = (uint64_t *) malloc(requests * sizeof(uint64_t));
+  slots = (LoopbackSlot_P) calloc(concurrency, sizeof(LoopbackSlot_T));
+  if(run.client != NULL && run.latencies != NULL && slots != NULL)
+	run.server = addAsyncServer(run.client, serverName, port, connections);
+
+  if(run.server >= 0)
+  {
+	//each outstanding request is sent again by its own callback until none are left
+	start = bench_Clock();
+	for(i = 0; i < concurrency && run.remaining > 0; i++)
+	{
+		slots[i].run = &run;
+		slots[i].sentAt = bench_Clock();
+		run.remaining--;
+		sendAsyncRequest(run.client, run.server, corpus[run.next], levelResponse, &slots[i]);
+		if(corpus[++run.next] == NULL) run.next = 0;
+	}
+	waitAsyncClient(run.client);
+	elapsed = bench_Clock() - start;
+	fillResult(result, run.latencies, run.completed, elapsed);
+	failed = run.failed + run.remaining;
+  }
+
+  //a level that could not run frees what it has too
+  if(run.client != NULL) closeAsyncClient(run.client);
+  free(run.latencies);
+  free(slots);
+  return failed;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void levelResponse(void *context, int id, int status, char *response){
+  LoopbackSlot_P slot = (LoopbackSlot_P) context;
+  LoopbackRun_P run = slot->run;
+  uint64_t now = bench_Clock();
+  if(status == 0)
+	run->latencies[run->completed++] = now - slot->sentAt;
+  else
+  {
+	//a failed connection fails the rest of the level too
+	run->failed++;
+	return;
+  }
+  if(run->remaining == 0) return;
+  run->remaining--;
+  slot->sentAt = now;
+  sendAsyncRequest(run->client, run->server, run->corpus[run->next], levelResponse, slot);
+  if(run->corpus[++run->next] == NULL) run->next = 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int runConnects(char *serverName, int port, int count, BenchResult_P result){
+  struct sockaddr_in servDest;
+  char response[MAX_RESPONSE];
+  uint64_t *latencies = (uint64_t *) malloc(count * sizeof(uint64_t));
+  uint64_t start = 0, sentAt = 0;
+  int completed = 0, sockfd = -1, i = 0;
+
+  memset((void *) result, 0, sizeof(BenchResult_T));
+  strcpy(result->name, "loopback/connect");
+  if(latencies == NULL) return count;
+  start = bench_Clock();
+  for(i = 0; i < count; i++)
+  {
+	sentAt = bench_Clock();
+	sockfd = createSocket(serverName, port, &servDest);
+	if(sockfd < 0) continue;
+	if(sendRequest(sockfd, echoCorpus[0], &servDest) == 0 && receiveResponse(sockfd, response) == 0)
+		latencies[completed++] = bench_Clock() - sentAt;
+	closeSocket(sockfd);
+  }
+  fillResult(result, latencies, completed, bench_Clock() - start);
+  free(latencies);
+  return count - completed;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void fillResult(BenchResult_P result, uint64_t *latencies, int count, uint64_t elapsed){
+  if(count == 0) return;
+  qsort(latencies, count, sizeof(uint64_t), compareLatencies);
+  result->opsPerSec = count * (double) BENCH_NANOSECONDS / elapsed;
+  result->p50Us = latencies[(int) (count * 0.50)] / MICROSECOND;
+  result->p99Us = latencies[(int) (count * 0.99)] / MICROSECOND;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int compareLatencies(const void *first, const void *second){
+  uint64_t a = *(uint64_t *) first, b = *(uint64_t *) second;
+  return (a > b) - (a < b);
+}
@@ -0,0 +1,374 @@
+/**	@file TCPcapture.c
+ * 	@brief Contains the function implementations for recording the requests sent to the TCP server
+ *	into a capture file and reading them back for replay.
+ *	Every thread that serves clients appends its requests to buffers of its own, so the threads
+ *	never wait for each other. A separate writer thread swaps each full buffer for an empty one
+ *	and writes it to the file, so recording costs a memcpy on the request path and never waits
+ *	for the disk.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "TCPcapture.h"
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	A buffer of encoded records waiting to be written
+ */
+typedef struct CaptureBuffer{
+  char data[CAPTURE_BUFFER_SIZE];
+  int length;
+}CaptureBuffer_T, *CaptureBuffer_P;
+
+/*
+ *	The buffers of one recording thread
+ */
+typedef struct CaptureLog{
+  CaptureBuffer_P active;	//records are appended here
+  CaptureBuffer_P spare;	//empty buffer swapped in by the writer thread
+  pthread_mutex_t lock;	//only ever shared with the writer thread while it swaps the buffers
+  struct CaptureLog *next;
+}CaptureLog_T, *CaptureLog_P;
+
+/*
+ *	State of the open capture
+ */
+typedef struct Capture{
+  FILE *file;
+  int running;
+  int pending;	//non zero once a recording thread has put records into an empty buffer
+  unsigned long dropped;
+  unsigned long generation;	//counts the captures opened, so a thread's log from an earlier one is not used
+  struct timespec start;
+  CaptureLog_P logs;	//one per recording thread
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+}Capture_T, *Capture_P;
+
+static Capture_T capture = { NULL, 0, 0, 0, 0, {0, 0}, NULL, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+static __thread CaptureLog_P threadLog = NULL;	//the log of the calling thread
+static __thread unsigned long threadGeneration = 0;	//the capture threadLog belongs to
+
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	The writer thread. Waits for recorded requests and writes them to the capture file.
+*	@param 	is not used.
+*	@return returns a void pointer.
+*/
+void *captureWriter( void * param );
+
+/**	@brief 	Returns the log of the calling thread, and makes one the first time the thread records.
+*	@param 	no parameter is passed.
+*	@return returns the log, or NULL if there is not enough memory.
+*/
+CaptureLog_P captureLog(void);
+
+/**	@brief 	Writes the records of every thread to the capture file.
+*	@param 	no parameter is passed.
+*	@return returns nothing.
+*/
+void drainLogs(void);
+
+/**	@brief 	Stores a number in little endian byte order.
+*	@param 	*out is where the bytes are written.
+*			value is the number to store.
+*			bytes is the number of bytes to write.
+*	@return returns nothing.
+*/
+void putLittleEndian(char *out, uint64_t value, int bytes);
+
+/**	@brief 	Reads a number stored in little endian byte order.
+*	@param 	*in is where the bytes are read from.
+*			bytes is the number of bytes to read.
+*	@return returns the number.
+*/
+uint64_t getLittleEndian(unsigned char *in, int bytes);
+
+
+/*
+ **************************************************
+ *		CAPTURE FUNCTIONS
+ **************************************************
+ */
+
+/*
+ **************************************************
+ **************************************************
+ */
+int open_Capture(char *fileName){
+  char header[CAPTURE_HEADER_LENGTH];
+  capture.file = fopen(fileName, "wb");
+  if(capture.file == NULL) return -1;
+
+  memcpy(header, CAPTURE_MAGIC, CAPTURE_MAGIC_LENGTH);
+  putLittleEndian(header + CAPTURE_MAGIC_LENGTH, CAPTURE_VERSION, 4);
+  if(fwrite(header, CAPTURE_HEADER_LENGTH, 1, capture.file) != 1)
+  {
+	fclose(capture.file);
+	capture.file = NULL;
+	return -1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &capture.start);
+  capture.dropped = 0;
+  capture.pending = 0;
+  capture.generation++;
+  capture.running = 1;
+  if(pthread_create(&capture.writer, NULL, captureWriter, NULL) != 0)
+  {
+	capture.running = 0;
+	close_Capture();
+	return -1;
+  }
+  return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void record_Capture(uint32_t connection, char *request, int length){
+  struct timespec now;
+  CaptureLog_P log;
+  CaptureBuffer_P buffer;
+  char *out;
+  int wake = 0;
+  if(!capture.running || length <= 0) return;
+  if(length > CAPTURE_MAX_REQUEST) length = CAPTURE_MAX_REQUEST;
+  log = captureLog();
+  if(log == NULL)
+  {
+	__sync_fetch_and_add(&capture.dropped, 1);
+	return;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  pthread_mutex_lock(&log->lock);
+  buffer = log->active;
+  if(buffer->length + CAPTURE_RECORD_HEADER_LENGTH + length > CAPTURE_BUFFER_SIZE)
+  {
+	//the writer is behind; drop the request rather than slow the client down
+	pthread_mutex_unlock(&log->lock);
+	__sync_fetch_and_add(&capture.dropped, 1);
+	return;
+  }
+  out = buffer->data + buffer->length;
+  putLittleEndian(out, (uint64_t) (now.tv_sec - capture.start.tv_sec) * 1000000000ULL + now.tv_nsec - capture.start.tv_nsec, 8);
+  putLittleEndian(out + 8, connection, 4);
+  putLittleEndian(out + 12, (uint64_t) length, 2);
+  memcpy(out + CAPTURE_RECORD_HEADER_LENGTH, request, length);
+  wake = (buffer->length == 0);
+  buffer->length += CAPTURE_RECORD_HEADER_LENGTH + length;
+  pthread_mutex_unlock(&log->lock);
+
+  //only an empty buffer needs to wake the writer, it drains everything it finds
+  if(wake)
+  {
+	pthread_mutex_lock(&capture.lock);
+	capture.pending = 1;
+	pthread_cond_signal(&capture.ready);
+	pthread_mutex_unlock(&capture.lock);
+  }
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+CaptureLog_P captureLog(void){
+  CaptureLog_P log = NULL;
+  if(threadLog != NULL && threadGeneration == capture.generation) return threadLog;
+
+  log = (CaptureLog_P) calloc(1, sizeof(CaptureLog_T));
+  if(log == NULL) return NULL;
+  log->active = (CaptureBuffer_P) calloc(1, sizeof(CaptureBuffer_T));
+  log->spare = (CaptureBuffer_P) calloc(1, sizeof(CaptureBuffer_T));
+  if(log->active == NULL || log->spare == NULL)
+  {
+	free(log->active);
+	free(log->spare);
+	free(log);
+	return NULL;
+  }
+  pthread_mutex_init(&log->lock, NULL);
+  pthread_mutex_lock(&capture.lock);
+  log->next = capture.logs;
+  capture.logs = log;
+  pthread_mutex_unlock(&capture.lock);
+  threadLog = log;
+  threadGeneration = capture.generation;
+  return log;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void *captureWriter( void * param ){
+  int stopping = 0;
+  pthread_mutex_lock(&capture.lock);
+  while(!stopping)
+  {
+	while(capture.running && !capture.pending)
+		pthread_cond_wait(&capture.ready, &capture.lock);
+	//records made once pending is cleared either are drained below or set it again
+	stopping = !capture.running;
+	capture.pending = 0;
+	pthread_mutex_unlock(&capture.lock);
+	drainLogs();
+	pthread_mutex_lock(&capture.lock);
+  }
+  pthread_mutex_unlock(&capture.lock);
+  return NULL;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void drainLogs(void){
+  CaptureLog_P log;
+  CaptureBuffer_P full;
+  int length = 0, written = 0;
+  pthread_mutex_lock(&capture.lock);
+  log = capture.logs;
+  pthread_mutex_unlock(&capture.lock);
+  //logs are only ever added at the head, so the rest of the list can be walked without the lock
+  for(; log != NULL; log = log->next)
+  {
+	//swap in the empty buffer and write the full one without holding the lock
+	pthread_mutex_lock(&log->lock);
+	full = log->active;
+	length = full->length;
+	if(length > 0)
+	{
+		log->active = log->spare;
+		log->spare = full;
+	}
+	pthread_mutex_unlock(&log->lock);
+	if(length == 0) continue;
+	fwrite(full->data, length, 1, capture.file);
+	full->length = 0;
+	written = 1;
+  }
+  if(written) fflush(capture.file);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void close_Capture(void){
+  CaptureLog_P log;
+  if(capture.file == NULL) return;
+  pthread_mutex_lock(&capture.lock);
+  if(capture.running)
+  {
+	capture.running = 0;
+	pthread_cond_signal(&capture.ready);
+	pthread_mutex_unlock(&capture.lock);
+	pthread_join(capture.writer, NULL);
+  }
+  else
+	pthread_mutex_unlock(&capture.lock);
+
+  if(capture.dropped > 0)
+	fprintf(stderr, "Capture dropped %lu requests\n", capture.dropped);
+  fclose(capture.file);
+  capture.file = NULL;
+  while((log = capture.logs) != NULL)
+  {
+	capture.logs = log->next;
+	pthread_mutex_destroy(&log->lock);
+	free(log->active);
+	free(log->spare);
+	free(log);
+  }
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+FILE *open_Capture_Reader(char *fileName){
+  unsigned char header[CAPTURE_HEADER_LENGTH];
+  FILE *file = fopen(fileName, "rb");
+  if(file == NULL) return NULL;
+  if(fread(header, CAPTURE_HEADER_LENGTH, 1, file) != 1 || memcmp(header, CAPTURE_MAGIC, CAPTURE_MAGIC_LENGTH) || getLittleEndian(header + CAPTURE_MAGIC_LENGTH, 4) != CAPTURE_VERSION)
+  {
+	fclose(file);
+	return NULL;
+  }
+  return file;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int read_Capture_Record(FILE *file, CaptureRecord_P record){
+  unsigned char header[CAPTURE_RECORD_HEADER_LENGTH];
+  size_t count = fread(header, 1, CAPTURE_RECORD_HEADER_LENGTH, file);
+  if(count == 0) return 0;
+  if(count != CAPTURE_RECORD_HEADER_LENGTH) return -1;
+
+  record->timestamp = getLittleEndian(header, 8);
+  record->connection = (uint32_t) getLittleEndian(header + 8, 4);
+  record->length = (uint16_t) getLittleEndian(header + 12, 2);
+  record->request = (char *) malloc(record->length + 1);
+  if(record->request == NULL) return -1;
+  if(fread(record->request, 1, record->length, file) != record->length)
+  {
+	free(record->request);
+	return -1;
+  }
+  record->request[record->length] = '\0';
+  return 1;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void putLittleEndian(char *out, uint64_t value, int bytes){
+  int i = 0;
+  for(i = 0; i < bytes; i++, value >>= 8)
+	out[i] = (char) (value & 0xff);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+uint64_t getLittleEndian(unsigned char *in, int bytes){
+  uint64_t value = 0;
+  int i = 0;
+  for(i = bytes - 1; i >= 0; i--)
+	value = (value << 8) | in[i];
+  return value;
+}
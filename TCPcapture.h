@@ -0,0 +1,99 @@
+/**	@file TCPcapture.h
+ * 	@brief Contains the function prototypes for recording the requests sent to the TCP server
+ *	into a capture file and reading them back, implemented in TCPcapture.c
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+/*
+ * TCPcapture.h
+ *
+ * A capture file starts with the CAPTURE_MAGIC bytes and a 4 byte version number,
+ * followed by one record per request:
+ *
+ *	8 bytes  - nanoseconds since the capture was opened
+ *	4 bytes  - id of the client connection the request arrived on
+ *	2 bytes  - length of the request
+ *	n bytes  - the request exactly as the client sent it
+ *
+ * All numbers are stored little endian. The requests of a connection are in the order they
+ * arrived, but every thread that serves clients records into buffers of its own, so the
+ * requests of different connections may be out of time order.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ **************************************************
+ *		COMPILER PRE DEFINES
+ **************************************************
+ */
+
+#define CAPTURE_MAGIC "TCAP"
+#define CAPTURE_MAGIC_LENGTH 4
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_LENGTH 8
+#define CAPTURE_RECORD_HEADER_LENGTH 14
+#define CAPTURE_BUFFER_SIZE (256 * 1024)
+#define CAPTURE_MAX_REQUEST 65535
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	One request read back from a capture file
+ */
+typedef struct CaptureRecord{
+  uint64_t timestamp;
+  uint32_t connection;
+  uint16_t length;
+  char *request;
+}CaptureRecord_T, *CaptureRecord_P;
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Opens a capture file and starts the thread that writes recorded requests to it.
+*	@param 	*fileName is the path of the capture file to create.
+*	@return returns 0 if the capture was opened, otherwise -1.
+*/
+int open_Capture(char *fileName);
+
+/**	@brief 	Records a request. The request is copied into a memory buffer of the calling
+*			thread that the writer thread saves to the file, so the caller never waits on the
+*			disk or on the other threads that record. Requests that do not fit into the buffer
+*			are dropped and counted. Does nothing if no capture is open.
+*	@param 	connection is the id of the client connection the request arrived on.
+*			*request is the request as the client sent it.
+*			length is the number of bytes in the request.
+*	@return returns nothing.
+*/
+void record_Capture(uint32_t connection, char *request, int length);
+
+/**	@brief 	Writes every recorded request to the file, stops the writer thread and closes the capture.
+*	@param 	no parameter is passed.
+*	@return returns nothing.
+*/
+void close_Capture(void);
+
+/**	@brief 	Opens a capture file for reading and checks its header.
+*	@param 	*fileName is the path of the capture file.
+*	@return returns the open file, or NULL if it cannot be opened or is not a capture file.
+*/
+FILE *open_Capture_Reader(char *fileName);
+
+/**	@brief 	Reads the next record from a capture file. The request is allocated with malloc
+*			and is NUL terminated; the caller frees it.
+*	@param 	*file is a capture file returned by open_Capture_Reader.
+*			*record is filled in with the next record.
+*	@return returns 1 if a record was read, 0 at the end of the file and -1 if the file is damaged.
+*/
+int read_Capture_Record(FILE *file, CaptureRecord_P record);
@@ -28,19 +28,32 @@ int printErrorMessage( char *message );
 */
 int create_TCP_Socket(void);
 
-/**	@brief 	get IP address of the server that the client will send messages to. 
-*	@param 	serverName is the name of the server. 
-*	@return returns a structure hostent that contains IP information about server. 
-*/
-struct hostent *info_Host(char * serverName);
-
 /**	@brief Set the destination address and port of the server. 
-*	@param 	hostptr is the structure containing information about the server 
+*	@param 	address is the IP address of the server 
 *			port is the port number to connect to the server 
 *			dest contains the destination IP address information. 
 *	@return returns nothing.
 */
-void setDestination(struct hostent *hostptr, int port, struct sockaddr_in *dest);
+void setDestination(struct in_addr *address, int port, struct sockaddr_in *dest);
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	A resolved server name, kept so that connecting again does not repeat the lookup
+ */
+typedef struct HostCacheEntry{
+  char name[NI_MAXHOST];
+  struct in_addr address;
+  time_t expires;
+}HostCacheEntry_T, *HostCacheEntry_P;
+
+static HostCacheEntry_T hostCache[HOST_CACHE_SIZE];
+static int hostCacheNext = 0;
+static pthread_mutex_t hostCacheLock = PTHREAD_MUTEX_INITIALIZER;
 
 /*
  **************************************************
@@ -68,23 +81,42 @@ int printErrorMessage( char *message ) {
  * return value - the socket identifier or a negative number indicating the error if a connection could not be established
  */
 int createSocket(char * serverName, int port, struct sockaddr_in * dest){
-	int listensockfd = 0;
-	struct hostent *hostptr; 
+	int listensockfd = 0, type = SOCK_STREAM, local = 0;
+	struct in_addr address; 
+	struct sockaddr_un localDest;
+
+	//servers on this host can be reached through their Unix domain socket instead
+	local = setLocalDestination(serverName, &localDest, &type);
+	if(local == -1) return printErrorMessage("Local Socket Path Is Too Long");
+	if(local == 1)
+	{
+		memset((void *) dest, 0, (size_t)sizeof(struct sockaddr_in));
+		listensockfd = socket(AF_UNIX, type, 0);
+		if(listensockfd == -1) return printErrorMessage("Cannot Open Local Socket");
+		if(connect(listensockfd, (struct sockaddr *) &localDest, sizeof(localDest)) == -1)
+		{
+			close(listensockfd);
+			return printErrorMessage("Cannot Connect to the Local Server");
+		}
+		return listensockfd;
+	}
+
+	//get client host information
+	if(resolveHost(serverName, &address) == -1) return -1;
 
 	//create the socket
 	listensockfd = create_TCP_Socket();
 	if(listensockfd == -1) return -1;
-
-	//get client host information
-	hostptr = info_Host(serverName);
-	if(hostptr == NULL) return -1;
 	
 	//set server destination
-	setDestination(hostptr, port, dest);
+	setDestination(&address, port, dest);
 	
 	//connect to the server
 	if(connect(listensockfd, (struct sockaddr *) dest, sizeof(*dest)) == -1)
+	{
+		close(listensockfd);
 		return printErrorMessage("Cannot Connect to the Server");
+	}
 	
 	//return the listening socket
 	return listensockfd;
@@ -106,21 +138,80 @@ int create_TCP_Socket(void){
  **************************************************
  **************************************************
  */
-struct hostent *info_Host(char * serverName){
-	struct hostent *hostptr; 
-	hostptr = gethostbyname(serverName);
-	if(hostptr == NULL) 
-		printErrorMessage("That Host Does Not Exist");			
-	return hostptr;
+int resolveHost(char * serverName, struct in_addr * address){
+	struct addrinfo hints, *result = NULL;
+	time_t now = time(NULL);
+	int i = 0;
+
+	//use the cached address while it is fresh
+	pthread_mutex_lock(&hostCacheLock);
+	for(i = 0; i < HOST_CACHE_SIZE; i++)
+	{
+		if(hostCache[i].expires > now && !strcmp(hostCache[i].name, serverName))
+		{
+			*address = hostCache[i].address;
+			pthread_mutex_unlock(&hostCacheLock);
+			return 0;
+		}
+	}
+	pthread_mutex_unlock(&hostCacheLock);
+
+	memset((void *) &hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if(getaddrinfo(serverName, NULL, &hints, &result) != 0 || result == NULL) 
+		return printErrorMessage("That Host Does Not Exist");
+	*address = ((struct sockaddr_in *) result->ai_addr)->sin_addr;
+	freeaddrinfo(result);
+
+	//names longer than the cache entry are simply looked up every time
+	if(strlen(serverName) < NI_MAXHOST)
+	{
+		pthread_mutex_lock(&hostCacheLock);
+		strcpy(hostCache[hostCacheNext].name, serverName);
+		hostCache[hostCacheNext].address = *address;
+		hostCache[hostCacheNext].expires = now + HOST_CACHE_SECONDS;
+		hostCacheNext = (hostCacheNext + 1) % HOST_CACHE_SIZE;
+		pthread_mutex_unlock(&hostCacheLock);
+	}
+	return 0;
 }
 
 /*
  **************************************************
  **************************************************
  */
-void setDestination(struct hostent *hostptr, int port, struct sockaddr_in *dest){
+int setLocalDestination(char * serverName, struct sockaddr_un * dest, int * type){
+	char * path = serverName;
+	if(!strncmp(serverName, LOCAL_PREFIX, strlen(LOCAL_PREFIX)))
+	{
+		path = serverName + strlen(LOCAL_PREFIX);
+		*type = SOCK_STREAM;
+	}
+	else if(!strncmp(serverName, SEQPACKET_PREFIX, strlen(SEQPACKET_PREFIX)))
+	{
+		path = serverName + strlen(SEQPACKET_PREFIX);
+		*type = SOCK_SEQPACKET;
+	}
+	else if(serverName[0] == '/')
+		*type = SOCK_STREAM;
+	else
+		return 0;
+
+	if(strlen(path) >= sizeof(dest->sun_path)) return -1;
+	memset((void *) dest, 0, (size_t)sizeof(struct sockaddr_un));
+	dest->sun_family = AF_UNIX;
+	strcpy(dest->sun_path, path);
+	return 1;
+}
+
+/*
+ **************************************************
+ **************************************************
+ */
+void setDestination(struct in_addr *address, int port, struct sockaddr_in *dest){
 	memset((void *) dest, 0, (size_t)sizeof(struct sockaddr_in));  
-	memcpy((void *) &(dest->sin_addr), (void *) hostptr->h_addr, hostptr->h_length);
+	dest->sin_addr = *address;
 	dest->sin_family = (AF_INET);
 	dest->sin_port = htons((u_short) port);
 }
@@ -142,25 +233,97 @@ int sendRequest(int sock, char * request, struct sockaddr_in * dest){
 		printErrorMessage("Cannot Send NULL Message to the Server");
 		return -1;
 	}
-	error = sendto(sock, request, strlen(request), 0, (struct sockaddr *) dest, sizeof(*dest));
+	//the socket is connected, and local sockets refuse an address here
+	error = sendto(sock, request, strlen(request), 0, NULL, 0);
 	if(error == -1) return -1;
 	return 0;
 }
 
 /*
- * Receives the server's response formatted as an XML text string.
+ * Receives the server's response formatted as an XML text string. The response is read up to
+ * its closing tag, and the text of an echo reply is unescaped.
  *
  * sock     - the socket identifier
  * response - the server's response as an XML formatted string to be filled in by this function;
- *            memory is allocated for storing response
+ *            it must have room for MAX_RESPONSE bytes and is always NUL terminated
  *
  * return   - 0, if no error; otherwise, a negative number indicating the error
  */
 int receiveResponse(int sock, char * response){
-	int error = 0;
-	bzero(response, MAX_MESSAGE);
-	error = recvfrom(sock, response, MAX_MESSAGE, 0, NULL, NULL);
-	if(error == -1) return -1;
+	int received = 0, byteReceivedCount = 0, length = 0;
+	response[0] = '\0';
+	//a reply may take more than one receive, and the last byte is kept for the terminator
+	while((length = responseLength(response, received)) == 0 && received < MAX_RESPONSE - 1)
+	{
+		byteReceivedCount = recvfrom(sock, response + received, MAX_RESPONSE - 1 - received, 0, NULL, NULL);
+		if(byteReceivedCount <= 0) break;
+		received += byteReceivedCount;
+	}
+	response[(length > 0) ? unescapeResponse(response, length) : received] = '\0';
+	if(length == 0) return -1;
+	return 0;
+}
+
+/*
+ * Fetches a file from the server's root directory and waits for all of it.
+ *
+ * sock     - the socket identifier of a stream connection
+ * name     - the name of the file
+ * contents - set to the bytes of the file, allocated with malloc and freed by the caller
+ * length   - set to the number of bytes in the file
+ *
+ * return   - 0, if no error; -2 if the server answered with an error; otherwise, -1
+ */
+int requestFile(int sock, char * name, char ** contents, long * length){
+	char request[MAX_MESSAGE], * buffer = NULL, * grown = NULL, * start = NULL;
+	long capacity = MAX_MESSAGE, received = 0, total = 0, byteReceivedCount = 0;
+	int startLength = strlen(FILE_REPLY_START), headerLength = 0;
+	*contents = NULL;
+	*length = 0;
+	if(snprintf(request, sizeof(request), "<get-file>%s</get-file>\n", name) >= sizeof(request)) return -1;
+	if(sendRequest(sock, request, NULL) == -1) return -1;
+
+	buffer = (char *) malloc(capacity);
+	if(buffer == NULL) return -1;
+	while(total == 0 || received < total)
+	{
+		//once the header is in, the buffer is grown to the whole reply at once
+		if(received == capacity)
+		{
+			capacity = (total > capacity) ? total : capacity * 2;
+			grown = (char *) realloc(buffer, capacity);
+			if(grown == NULL) break;
+			buffer = grown;
+		}
+		byteReceivedCount = recvfrom(sock, buffer + received, capacity - received, 0, NULL, NULL);
+		if(byteReceivedCount <= 0) break;
+		received += byteReceivedCount;
+		if(total > 0) continue;
+		//the header of a file reply tells how much is still to come; anything else is an error
+		if(received >= startLength && !memcmp(buffer, FILE_REPLY_START, startLength))
+		{
+			if((start = memchr(buffer, '>', received)) != NULL)
+				total = (start + 1 - buffer) + strtol(buffer + startLength, NULL, 10) + strlen(FILE_REPLY_END);
+		}
+		else
+			total = responseLength(buffer, received);
+	}
+	if(total == 0 || received < total)
+	{
+		free(buffer);
+		return -1;
+	}
+	if(received < startLength || memcmp(buffer, FILE_REPLY_START, startLength))
+	{
+		free(buffer);
+		return -2;
+	}
+
+	//keep only the file, moved to the front of the buffer
+	headerLength = (char *) memchr(buffer, '>', received) + 1 - buffer;
+	*length = total - headerLength - strlen(FILE_REPLY_END);
+	memmove(buffer, buffer + headerLength, *length);
+	*contents = buffer;
 	return 0;
 }
 
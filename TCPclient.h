@@ -25,6 +25,10 @@
 #include <sys/ioctl.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <sys/un.h>
+#include <time.h>
+#include <limits.h>
+#include "TCPresponse.h"
 
 /*
  **************************************************
@@ -33,6 +37,11 @@
  */
 
 #define MAX_MESSAGE 256
+#define MAX_RESPONSE (MAX_MESSAGE * 5 + 32)	//the longest reply on the wire, an echo of nothing but '&'
+#define HOST_CACHE_SIZE 64
+#define HOST_CACHE_SECONDS 60
+#define LOCAL_PREFIX "unix:"
+#define SEQPACKET_PREFIX "seqpacket:"
 
 
  /*
@@ -43,8 +52,11 @@
  
 /*
  * Creates a streaming socket and connects to a server.
+ * A server on the same host can be reached through its Unix domain socket by giving
+ * its path, either as is, starting with '/', or after LOCAL_PREFIX; the port is then
+ * ignored. A path after SEQPACKET_PREFIX connects to a SOCK_SEQPACKET socket.
  *
- * serverName - the ip address or hostname of the server given as a string
+ * serverName - the ip address, hostname or local socket path of the server given as a string
  * port       - the port number of the server
  * dest       - the server's address information; the structure should be created with information
  *              on the server (like port, address, and family) in this function call
@@ -53,29 +65,66 @@
  */
 int createSocket(char * serverName, int port, struct sockaddr_in * dest);
 
+/*
+ * Looks up the IP address of a server. Addresses are cached for HOST_CACHE_SECONDS,
+ * so connecting to the same server again does not repeat the lookup.
+ *
+ * serverName - the ip address or hostname of the server given as a string
+ * address    - filled in with the server's IP address
+ *
+ * return - 0, if no error; otherwise, a negative number indicating the error
+ */
+int resolveHost(char * serverName, struct in_addr * address);
+
+/*
+ * Works out whether a server name is the path of a Unix domain socket on this host.
+ *
+ * serverName - the server name given to createSocket
+ * dest       - filled in with the socket's address if the name is a local socket path
+ * type       - set to SOCK_STREAM or SOCK_SEQPACKET if the name is a local socket path
+ *
+ * return - 1 for a local socket path, 0 for a host name and -1 if the path is too long
+ */
+int setLocalDestination(char * serverName, struct sockaddr_un * dest, int * type);
+
 /*
  * Sends a request for service to the server. This is an asynchronous call to the server, 
  * so do not wait for a reply in this function.
  * 
  * sock    - the socket identifier
  * request - the request to be sent encoded as a string
- * dest    - the server's address information
+ * dest    - the server's address information; unused since the socket is already connected
  *
  * return   - 0, if no error; otherwise, a negative number indicating the error
  */
 int sendRequest(int sock, char * request, struct sockaddr_in * dest);
 
 /*
- * Receives the server's response formatted as an XML text string.
+ * Receives the server's response formatted as an XML text string. The response is read up to
+ * its closing tag, and the text of an echo reply is unescaped.
  *
  * sock     - the socket identifier
  * response - the server's response as an XML formatted string to be filled in by this function;
- *            memory is allocated for storing response
+ *            it must have room for MAX_RESPONSE bytes and is always NUL terminated
  *
  * return   - 0, if no error; otherwise, a negative number indicating the error
  */
 int receiveResponse(int sock, char * response);
 
+/*
+ * Fetches a file from the server's root directory and waits for all of it. The reply is
+ * <replyFile length="N"> followed by the N bytes of the file and </replyFile>, so the file
+ * may be larger than MAX_MESSAGE and contain anything.
+ *
+ * sock     - the socket identifier of a stream connection
+ * name     - the name of the file
+ * contents - set to the bytes of the file, allocated with malloc and freed by the caller
+ * length   - set to the number of bytes in the file
+ *
+ * return   - 0, if no error; -2 if the server answered with an error; otherwise, -1
+ */
+int requestFile(int sock, char * name, char ** contents, long * length);
+
 /*
  * Prints the response to the screen in a formatted way.
  *
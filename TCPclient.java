@@ -84,7 +84,7 @@ public class TCPclient
 
 	/**
 	 * Receives the server's response. Also displays the response in a
-	 * clear and concise format.
+	 * clear and concise format. The text of an echo reply is unescaped.
 	 *
 	 * @return - the server's response or NULL if an error occured
 	 */
@@ -102,7 +102,22 @@ public class TCPclient
             System.err.println("Exception in receiveResponse");
         	return null;
 		}
-		return response;
+		return unescapeResponse(response);
+	}
+
+	/*
+     * Turns the escaped text of a <reply> back into the text that was echoed. The server
+     * sends '<' as "&lt;" and '&' as "&amp;" so that echoed text cannot end its reply early.
+     *
+     * response - the server's response as an XML formatted string
+     *
+     * return - the response with the echoed text as it was sent
+     */
+	public static String unescapeResponse(String response)
+	{
+		if(!response.startsWith("<reply>"))
+			return response;
+		return response.replace("&lt;", "<").replace("&amp;", "&"); //"&lt;" first, or "&amp;lt;" would become "<"
 	}
 	
 	/*
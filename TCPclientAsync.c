@@ -0,0 +1,686 @@
+/**	@file TCPclientAsync.c
+ * 	@brief Contains the function implementations of the asynchronous TCP client in C.
+ *	Every server gets a pool of non-blocking connections that are all watched by one epoll
+ *	instance, so a single thread can keep requests in flight to hundreds of servers.
+ *	Requests are appended to their connection's send buffer and written together when the
+ *	client is polled, and responses are matched to requests in order on each connection.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+#include "TCPclientAsync.h"
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	A growable byte buffer; bytes before offset have already been consumed
+ */
+typedef struct AsyncBuffer{
+  char * data;
+  int offset;
+  int length;
+  int capacity;
+}AsyncBuffer_T, *AsyncBuffer_P;
+
+/*
+ *	A request waiting for its response
+ */
+typedef struct AsyncPending{
+  int id;
+  int length;	//bytes of the request in the send buffer
+  AsyncCallback callback;
+  void * context;
+}AsyncPending_T, *AsyncPending_P;
+
+/*
+ *	States of a connection
+ */
+enum AsyncState{ ASYNC_CLOSED, ASYNC_CONNECTING, ASYNC_CONNECTED };
+
+/*
+ *	One pooled connection to a server
+ */
+typedef struct AsyncConnection{
+  int sockfd;
+  int server;
+  enum AsyncState state;
+  int dirty;	//non zero while the connection is on the client's dirty list
+  AsyncBuffer_T send;
+  AsyncBuffer_T recv;
+  AsyncPending_P pending;	//ring of requests in the order they were queued
+  int pendingHead;
+  int pendingCount;
+  int pendingCapacity;
+  int unsent;	//pending requests not yet sent as packets, on SOCK_SEQPACKET connections
+}AsyncConnection_T, *AsyncConnection_P;
+
+/*
+ *	A server and the range of connections that belong to it
+ */
+typedef struct AsyncServer{
+  struct sockaddr_storage dest;	//sockaddr_in for TCP servers, sockaddr_un for local ones
+  socklen_t destLength;
+  int type;
+  int firstConnection;
+  int connectionCount;
+}AsyncServer_T, *AsyncServer_P;
+
+struct AsyncClient{
+  int epollfd;
+  AsyncServer_P servers;
+  int serverCount;
+  AsyncConnection_P * connections;
+  int connectionCount;
+  AsyncConnection_P * dirty;	//connections with requests that were queued but not written
+  int dirtyCount;
+  AsyncResponse_P completed;	//ring of responses waiting for nextAsyncResponse
+  int completedHead;
+  int completedCount;
+  int completedCapacity;
+  int nextId;
+  int pendingCount;
+  int delivered;
+};
+
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Makes room for more bytes at the end of a buffer.
+*	@param 	buffer is the buffer to grow.
+*			needed is the number of free bytes required after the data.
+*	@return returns 0, or -1 if there is not enough memory.
+*/
+int reserveBuffer(AsyncBuffer_P buffer, int needed);
+
+/**	@brief 	Opens a non-blocking socket for the connection and starts connecting it.
+*	@param 	client is the asynchronous client.
+*			connection is the connection to open.
+*	@return returns 0 if the connection is open or opening, otherwise -1.
+*/
+int startConnection(AsyncClient_P client, AsyncConnection_P connection);
+
+/**	@brief 	Writes as much of the connection's send buffer as the socket takes.
+*	@param 	client is the asynchronous client.
+*			connection is the connection to write.
+*	@return returns nothing.
+*/
+void flushConnection(AsyncClient_P client, AsyncConnection_P connection);
+
+/**	@brief 	Sends the queued requests of a SOCK_SEQPACKET connection, one packet per request
+*			so that no packet is larger than the server reads, but many packets per system call.
+*	@param 	client is the asynchronous client.
+*			connection is the connection to write.
+*	@return returns nothing.
+*/
+void flushPackets(AsyncClient_P client, AsyncConnection_P connection);
+
+/**	@brief 	Reads everything the server has sent and delivers every whole response. A
+*			response that no request is waiting for fails the connection.
+*	@param 	client is the asynchronous client.
+*			connection is the connection to read.
+*	@return returns nothing.
+*/
+void readConnection(AsyncClient_P client, AsyncConnection_P connection);
+
+/**	@brief 	Closes a connection and fails every request that was waiting on it.
+*	@param 	client is the asynchronous client.
+*			connection is the connection that failed.
+*	@return returns nothing.
+*/
+void failConnection(AsyncClient_P client, AsyncConnection_P connection);
+
+/**	@brief 	Hands the oldest request of a connection, now finished, to its callback or to
+*			the completed queue. Does nothing if the connection has no request waiting.
+*	@param 	client is the asynchronous client.
+*			connection is the connection the request was sent on.
+*			status is 0 if a response arrived, otherwise a negative number.
+*			response and length are the response, whose echoed text is unescaped in place, or NULL
+*			and 0 on error.
+*	@return returns 0, or -1 if there was no memory to keep the response; the request is
+*			finished either way.
+*/
+int deliverResponse(AsyncClient_P client, AsyncConnection_P connection, int status, char * response, int length);
+
+/**	@brief 	Changes the events epoll watches for on a connection.
+*	@param 	client is the asynchronous client.
+*			connection is the connection to watch.
+*	@return returns nothing.
+*/
+void watchConnection(AsyncClient_P client, AsyncConnection_P connection);
+
+
+/*
+ **************************************************
+ *		ASYNCHRONOUS CLIENT FUNCTIONS
+ **************************************************
+ */
+
+/*
+ **************************************************
+ **************************************************
+ */
+AsyncClient_P createAsyncClient(void){
+	AsyncClient_P client = (AsyncClient_P) calloc(1, sizeof(AsyncClient_T));
+	if(client == NULL) return NULL;
+	client->epollfd = epoll_create1(EPOLL_CLOEXEC);
+	if(client->epollfd == -1)
+	{
+		free(client);
+		return NULL;
+	}
+	return client;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int addAsyncServer(AsyncClient_P client, char * serverName, int port, int connections){
+	struct in_addr address;
+	struct sockaddr_un localDest;
+	AsyncServer_P servers;
+	AsyncConnection_P * all, * dirty;
+	int i = 0, type = SOCK_STREAM, local = 0;
+
+	if(connections < 1) return -1;
+	local = setLocalDestination(serverName, &localDest, &type);
+	if(local == -1) return -1;
+	if(local == 0 && resolveHost(serverName, &address) == -1) return -1;
+
+	servers = (AsyncServer_P) realloc(client->servers, (client->serverCount + 1) * sizeof(AsyncServer_T));
+	if(servers == NULL) return -1;
+	client->servers = servers;
+	all = (AsyncConnection_P *) realloc(client->connections, (client->connectionCount + connections) * sizeof(AsyncConnection_P));
+	if(all == NULL) return -1;
+	client->connections = all;
+	//a connection is on the dirty list at most once, so the list never outgrows the pool
+	dirty = (AsyncConnection_P *) realloc(client->dirty, (client->connectionCount + connections) * sizeof(AsyncConnection_P));
+	if(dirty == NULL) return -1;
+	client->dirty = dirty;
+
+	memset((void *) &servers[client->serverCount], 0, sizeof(AsyncServer_T));
+	servers[client->serverCount].type = type;
+	if(local)
+	{
+		memcpy(&servers[client->serverCount].dest, &localDest, sizeof(localDest));
+		servers[client->serverCount].destLength = sizeof(localDest);
+	}
+	else
+	{
+		struct sockaddr_in * dest = (struct sockaddr_in *) &servers[client->serverCount].dest;
+		dest->sin_family = AF_INET;
+		dest->sin_addr = address;
+		dest->sin_port = htons((u_short) port);
+		servers[client->serverCount].destLength = sizeof(struct sockaddr_in);
+	}
+	servers[client->serverCount].firstConnection = client->connectionCount;
+
+	for(i = 0; i < connections; i++)
+	{
+		AsyncConnection_P connection = (AsyncConnection_P) calloc(1, sizeof(AsyncConnection_T));
+		if(connection == NULL) break;
+		connection->sockfd = -1;
+		connection->server = client->serverCount;
+		client->connections[client->connectionCount++] = connection;
+		servers[client->serverCount].connectionCount++;
+		//a connection that cannot start now is retried when a request is queued on it
+		startConnection(client, connection);
+	}
+	if(servers[client->serverCount].connectionCount == 0) return -1;
+	return client->serverCount++;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int sendAsyncRequest(AsyncClient_P client, int server, char * request, AsyncCallback callback, void * context){
+	AsyncServer_P target;
+	AsyncConnection_P connection = NULL, candidate;
+	AsyncPending_P pending;
+	int length = 0, newline = 0, i = 0, capacity = 0;
+
+	if(server < 0 || server >= client->serverCount || request == NULL || request[0] == '\0') return -1;
+	//the server refuses a request longer than its buffer, newline included
+	length = strlen(request);
+	newline = (request[length - 1] != '\n');
+	if(length + newline > MAX_MESSAGE - 1) return -1;
+	target = &client->servers[server];
+
+	//the open connection with the fewest requests in flight; closed ones only if nothing is open
+	for(i = 0; i < target->connectionCount; i++)
+	{
+		candidate = client->connections[target->firstConnection + i];
+		if(connection == NULL || (connection->state == ASYNC_CLOSED && candidate->state != ASYNC_CLOSED) ||
+			((candidate->state == ASYNC_CLOSED) == (connection->state == ASYNC_CLOSED) && candidate->pendingCount < connection->pendingCount))
+			connection = candidate;
+	}
+	if(connection->state == ASYNC_CLOSED && startConnection(client, connection) == -1) return -1;
+
+	if(reserveBuffer(&connection->send, length + newline) == -1) return -1;
+	if(connection->pendingCount == connection->pendingCapacity)
+	{
+		//grow the ring and unwrap it so the oldest request is first
+		capacity = connection->pendingCapacity ? connection->pendingCapacity * 2 : 16;
+		pending = (AsyncPending_P) malloc(capacity * sizeof(AsyncPending_T));
+		if(pending == NULL) return -1;
+		for(i = 0; i < connection->pendingCount; i++)
+			pending[i] = connection->pending[(connection->pendingHead + i) % connection->pendingCapacity];
+		free(connection->pending);
+		connection->pending = pending;
+		connection->pendingHead = 0;
+		connection->pendingCapacity = capacity;
+	}
+
+	memcpy(connection->send.data + connection->send.length, request, length);
+	if(newline) connection->send.data[connection->send.length + length] = '\n';
+	connection->send.length += length + newline;
+
+	pending = &connection->pending[(connection->pendingHead + connection->pendingCount) % connection->pendingCapacity];
+	pending->id = client->nextId++;
+	pending->length = length + newline;
+	if(client->nextId < 0) client->nextId = 0;
+	pending->callback = callback;
+	pending->context = context;
+	connection->pendingCount++;
+	client->pendingCount++;
+
+	if(!connection->dirty)
+	{
+		connection->dirty = 1;
+		client->dirty[client->dirtyCount++] = connection;
+	}
+	return pending->id;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int pollAsyncClient(AsyncClient_P client, int timeout){
+	struct epoll_event events[ASYNC_MAX_EVENTS];
+	AsyncConnection_P connection;
+	int delivered = client->delivered, count = 0, error = 0, i = 0;
+	socklen_t errorLength = sizeof(error);
+
+	//write everything queued since the last poll, one write per connection
+	for(i = 0; i < client->dirtyCount; i++)
+	{
+		connection = client->dirty[i];
+		connection->dirty = 0;
+		if(connection->state == ASYNC_CONNECTED) flushConnection(client, connection);
+	}
+	client->dirtyCount = 0;
+
+	//do not sleep if failed writes already delivered something
+	if(client->delivered != delivered) timeout = 0;
+	count = epoll_wait(client->epollfd, events, ASYNC_MAX_EVENTS, timeout);
+	if(count == -1)
+		return (errno == EINTR) ? client->delivered - delivered : -1;
+
+	for(i = 0; i < count; i++)
+	{
+		connection = (AsyncConnection_P) events[i].data.ptr;
+		if(connection->state == ASYNC_CONNECTING)
+		{
+			if(getsockopt(connection->sockfd, SOL_SOCKET, SO_ERROR, &error, &errorLength) == -1 || error != 0)
+			{
+				failConnection(client, connection);
+				continue;
+			}
+			connection->state = ASYNC_CONNECTED;
+			flushConnection(client, connection);
+		}
+		if(connection->state == ASYNC_CONNECTED && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+			readConnection(client, connection);
+		if(connection->state == ASYNC_CONNECTED && (events[i].events & EPOLLOUT))
+			flushConnection(client, connection);
+	}
+	return client->delivered - delivered;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int waitAsyncClient(AsyncClient_P client){
+	while(client->pendingCount > 0)
+		if(pollAsyncClient(client, -1) < 0) return -1;
+	return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int pendingAsyncRequests(AsyncClient_P client){
+	return client->pendingCount;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int nextAsyncResponse(AsyncClient_P client, AsyncResponse_P response){
+	if(client->completedCount == 0) return 0;
+	*response = client->completed[client->completedHead];
+	client->completedHead = (client->completedHead + 1) % client->completedCapacity;
+	client->completedCount--;
+	return 1;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void closeAsyncClient(AsyncClient_P client){
+	AsyncConnection_P connection;
+	int i = 0;
+	for(i = 0; i < client->connectionCount; i++)
+	{
+		connection = client->connections[i];
+		if(connection->sockfd != -1) close(connection->sockfd);
+		free(connection->send.data);
+		free(connection->recv.data);
+		free(connection->pending);
+		free(connection);
+	}
+	for(i = 0; i < client->completedCount; i++)
+		free(client->completed[(client->completedHead + i) % client->completedCapacity].response);
+	close(client->epollfd);
+	free(client->servers);
+	free(client->connections);
+	free(client->dirty);
+	free(client->completed);
+	free(client);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int reserveBuffer(AsyncBuffer_P buffer, int needed){
+	char * data;
+	int capacity = buffer->capacity ? buffer->capacity : ASYNC_BUFFER_SIZE;
+	if(buffer->length + needed <= buffer->capacity) return 0;
+
+	//reuse the space of consumed bytes before growing
+	if(buffer->offset > 0)
+	{
+		memmove(buffer->data, buffer->data + buffer->offset, buffer->length - buffer->offset);
+		buffer->length -= buffer->offset;
+		buffer->offset = 0;
+		if(buffer->length + needed <= buffer->capacity) return 0;
+	}
+	while(capacity < buffer->length + needed) capacity *= 2;
+	data = (char *) realloc(buffer->data, capacity);
+	if(data == NULL) return -1;
+	buffer->data = data;
+	buffer->capacity = capacity;
+	return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int startConnection(AsyncClient_P client, AsyncConnection_P connection){
+	struct epoll_event event;
+	AsyncServer_P server = &client->servers[connection->server];
+	int noDelay = 1;
+
+	connection->sockfd = socket(server->dest.ss_family, server->type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(connection->sockfd == -1) return -1;
+	//requests are already batched per poll, so do not let Nagle hold them back further
+	if(server->dest.ss_family == AF_INET)
+		setsockopt(connection->sockfd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+	if(connect(connection->sockfd, (struct sockaddr *) &server->dest, server->destLength) == 0)
+		connection->state = ASYNC_CONNECTED;
+	else if(errno == EINPROGRESS)
+		connection->state = ASYNC_CONNECTING;
+	else
+	{
+		close(connection->sockfd);
+		connection->sockfd = -1;
+		return -1;
+	}
+
+	event.events = EPOLLIN | EPOLLOUT;
+	event.data.ptr = connection;
+	if(epoll_ctl(client->epollfd, EPOLL_CTL_ADD, connection->sockfd, &event) == -1)
+	{
+		close(connection->sockfd);
+		connection->sockfd = -1;
+		connection->state = ASYNC_CLOSED;
+		return -1;
+	}
+	return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void flushConnection(AsyncClient_P client, AsyncConnection_P connection){
+	AsyncBuffer_P send = &connection->send;
+	int byteSentCount = 0;
+	if(client->servers[connection->server].type == SOCK_SEQPACKET)
+	{
+		flushPackets(client, connection);
+		return;
+	}
+	while(send->offset < send->length)
+	{
+		byteSentCount = sendto(connection->sockfd, send->data + send->offset, send->length - send->offset, MSG_NOSIGNAL, NULL, 0);
+		if(byteSentCount == -1)
+		{
+			if(errno == EINTR) continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+			failConnection(client, connection);
+			return;
+		}
+		send->offset += byteSentCount;
+	}
+	if(send->offset == send->length) send->offset = send->length = 0;
+	watchConnection(client, connection);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void flushPackets(AsyncClient_P client, AsyncConnection_P connection){
+	struct mmsghdr packets[ASYNC_MAX_PACKETS];
+	struct iovec parts[ASYNC_MAX_PACKETS];
+	AsyncBuffer_P send = &connection->send;
+	AsyncPending_P pending;
+	int count = 0, sent = 0, position = 0, i = 0;
+	while(connection->unsent < connection->pendingCount)
+	{
+		//the unsent requests start at the send offset, one packet each
+		position = send->offset;
+		for(count = 0, i = connection->unsent; i < connection->pendingCount && count < ASYNC_MAX_PACKETS; i++, count++)
+		{
+			pending = &connection->pending[(connection->pendingHead + i) % connection->pendingCapacity];
+			parts[count].iov_base = send->data + position;
+			parts[count].iov_len = pending->length;
+			position += pending->length;
+			memset((void *) &packets[count], 0, sizeof(struct mmsghdr));
+			packets[count].msg_hdr.msg_iov = &parts[count];
+			packets[count].msg_hdr.msg_iovlen = 1;
+		}
+		sent = sendmmsg(connection->sockfd, packets, count, MSG_NOSIGNAL);
+		if(sent == -1)
+		{
+			if(errno == EINTR) continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+			failConnection(client, connection);
+			return;
+		}
+		for(i = 0; i < sent; i++) send->offset += parts[i].iov_len;
+		connection->unsent += sent;
+	}
+	if(send->offset == send->length) send->offset = send->length = 0;
+	watchConnection(client, connection);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void readConnection(AsyncClient_P client, AsyncConnection_P connection){
+	AsyncBuffer_P recv = &connection->recv;
+	int byteReceivedCount = 0, length = 0;
+	while(1)
+	{
+		if(reserveBuffer(recv, ASYNC_BUFFER_SIZE) == -1)
+		{
+			failConnection(client, connection);
+			return;
+		}
+		//one byte stays free so a response can be NUL terminated in place
+		byteReceivedCount = recvfrom(connection->sockfd, recv->data + recv->length, recv->capacity - recv->length - 1, 0, NULL, NULL);
+		if(byteReceivedCount == -1 && errno == EINTR) continue;
+		if(byteReceivedCount == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+		if(byteReceivedCount <= 0)
+		{
+			failConnection(client, connection);
+			return;
+		}
+		recv->length += byteReceivedCount;
+
+		//deliver every whole response; a callback may queue new requests but not close the client
+		while((length = responseLength(recv->data + recv->offset, recv->length - recv->offset)) > 0)
+		{
+			//a response to nothing means the connection is out of step with its requests
+			if(connection->pendingCount == 0)
+			{
+				failConnection(client, connection);
+				return;
+			}
+			recv->offset += length;
+			//a response that cannot be kept is lost, so the ones after it would go to the wrong requests
+			if(deliverResponse(client, connection, 0, recv->data + recv->offset - length, length) == -1)
+			{
+				failConnection(client, connection);
+				return;
+			}
+		}
+		if(recv->offset == recv->length) recv->offset = recv->length = 0;
+	}
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void failConnection(AsyncClient_P client, AsyncConnection_P connection){
+	if(connection->sockfd != -1) close(connection->sockfd);
+	connection->sockfd = -1;
+	connection->state = ASYNC_CLOSED;
+	connection->send.offset = connection->send.length = 0;
+	connection->recv.offset = connection->recv.length = 0;
+	connection->unsent = 0;
+	while(connection->pendingCount > 0)
+		deliverResponse(client, connection, -1, NULL, 0);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int deliverResponse(AsyncClient_P client, AsyncConnection_P connection, int status, char * response, int length){
+	AsyncPending_T pending;
+	AsyncResponse_P completed;
+	char saved;
+	int capacity = 0, i = 0;
+
+	if(connection->pendingCount == 0) return 0;
+	if(response != NULL) length = unescapeResponse(response, length);
+	pending = connection->pending[connection->pendingHead];
+	connection->pendingHead = (connection->pendingHead + 1) % connection->pendingCapacity;
+	connection->pendingCount--;
+	if(connection->unsent > 0) connection->unsent--;
+	client->pendingCount--;
+	client->delivered++;
+
+	if(pending.callback != NULL)
+	{
+		//terminate the response in place for the callback, then put back the byte after it
+		if(response != NULL)
+		{
+			saved = response[length];
+			response[length] = '\0';
+		}
+		pending.callback(pending.context, pending.id, status, response);
+		if(response != NULL) response[length] = saved;
+		return 0;
+	}
+
+	if(client->completedCount == client->completedCapacity)
+	{
+		capacity = client->completedCapacity ? client->completedCapacity * 2 : 64;
+		completed = (AsyncResponse_P) malloc(capacity * sizeof(AsyncResponse_T));
+		if(completed == NULL) return -1;
+		for(i = 0; i < client->completedCount; i++)
+			completed[i] = client->completed[(client->completedHead + i) % client->completedCapacity];
+		free(client->completed);
+		client->completed = completed;
+		client->completedHead = 0;
+		client->completedCapacity = capacity;
+	}
+	completed = &client->completed[(client->completedHead + client->completedCount) % client->completedCapacity];
+	completed->id = pending.id;
+	completed->server = connection->server;
+	completed->status = status;
+	completed->response = NULL;
+	if(response != NULL)
+	{
+		completed->response = (char *) malloc(length + 1);
+		if(completed->response == NULL)
+			completed->status = -1;
+		else
+		{
+			memcpy(completed->response, response, length);
+			completed->response[length] = '\0';
+		}
+	}
+	client->completedCount++;
+	return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void watchConnection(AsyncClient_P client, AsyncConnection_P connection){
+	struct epoll_event event;
+	event.events = (connection->send.offset < connection->send.length) ? EPOLLIN | EPOLLOUT : EPOLLIN;
+	event.data.ptr = connection;
+	epoll_ctl(client->epollfd, EPOLL_CTL_MOD, connection->sockfd, &event);
+}
@@ -0,0 +1,154 @@
+/**	@file TCPclientAsync.h
+ * 	@brief Contains the function prototypes for the asynchronous TCP client that are
+ *	implemented in TCPclientAsync.c
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+/*
+ * TCPclientAsync.h
+ *
+ * The asynchronous client keeps a pool of non-blocking connections to every server it is
+ * given and never waits on a single server. Requests are queued and only written when the
+ * client is polled, so everything queued for a connection since the last poll goes out in
+ * one write. Responses are matched to requests in the order the requests were queued on
+ * their connection and are handed back through a callback or through nextAsyncResponse.
+ *
+ * The client is not thread safe; one thread queues requests and polls it.
+ */
+
+#define _GNU_SOURCE
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include "TCPclient.h"
+
+/*
+ **************************************************
+ *		COMPILER PRE DEFINES
+ **************************************************
+ */
+
+#define ASYNC_MAX_EVENTS 256
+#define ASYNC_BUFFER_SIZE 4096
+#define ASYNC_MAX_PACKETS 64
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ * Called once for every request when its response arrives or its connection fails.
+ *
+ * context  - the context given to sendAsyncRequest
+ * id       - the id sendAsyncRequest returned for the request
+ * status   - 0 if a response arrived; otherwise, a negative number indicating the error
+ * response - the NUL terminated response, with the text of an echo reply unescaped, or NULL
+ *            on error; only valid during the call
+ */
+typedef void (*AsyncCallback)(void * context, int id, int status, char * response);
+
+/*
+ * A response collected by nextAsyncResponse, for requests sent without a callback.
+ * response is allocated with malloc and freed by the caller; it is NULL on error.
+ */
+typedef struct AsyncResponse{
+  int id;
+  int server;
+  int status;
+  char * response;
+}AsyncResponse_T, *AsyncResponse_P;
+
+typedef struct AsyncClient AsyncClient_T, *AsyncClient_P;
+
+ /*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/*
+ * Creates an asynchronous client with no servers.
+ *
+ * return - the client, or NULL if it could not be created
+ */
+AsyncClient_P createAsyncClient(void);
+
+/*
+ * Adds a server and starts connecting its pool of connections without waiting for them.
+ * The server name is looked up once through the resolveHost cache. Local socket paths
+ * are accepted the same way as by createSocket.
+ *
+ * client      - the asynchronous client
+ * serverName  - the ip address, hostname or local socket path of the server given as a string
+ * port        - the port number of the server
+ * connections - the number of connections to keep open to the server
+ *
+ * return - the server id used by sendAsyncRequest, or a negative number indicating the error
+ */
+int addAsyncServer(AsyncClient_P client, char * serverName, int port, int connections);
+
+/*
+ * Queues a request for a server on its least busy connection. Nothing is written until the
+ * client is polled. A request that does not end with a newline gets one, so that the server
+ * can tell pipelined requests apart. Requests longer than MAX_MESSAGE - 1 bytes, newline
+ * included, are refused, since the server would refuse them too.
+ *
+ * client   - the asynchronous client
+ * server   - the server id returned by addAsyncServer
+ * request  - the request to be sent encoded as a string
+ * callback - called with the response, or NULL to collect it with nextAsyncResponse
+ * context  - passed to callback
+ *
+ * return - the id of the request, or a negative number indicating the error
+ */
+int sendAsyncRequest(AsyncClient_P client, int server, char * request, AsyncCallback callback, void * context);
+
+/*
+ * Writes the queued requests, reads the responses that have arrived and delivers them.
+ *
+ * client  - the asynchronous client
+ * timeout - milliseconds to wait for something to happen, 0 to not wait or -1 to wait forever
+ *
+ * return - the number of responses delivered, or a negative number indicating the error
+ */
+int pollAsyncClient(AsyncClient_P client, int timeout);
+
+/*
+ * Polls the client until every queued request has its response or has failed.
+ *
+ * client - the asynchronous client
+ *
+ * return - 0, if no error; otherwise, a negative number indicating the error
+ */
+int waitAsyncClient(AsyncClient_P client);
+
+/*
+ * Returns the number of requests that have not been answered yet.
+ *
+ * client - the asynchronous client
+ */
+int pendingAsyncRequests(AsyncClient_P client);
+
+/*
+ * Takes the oldest collected response of a request that was sent without a callback.
+ *
+ * client   - the asynchronous client
+ * response - filled in with the response
+ *
+ * return - 1 if a response was taken, 0 if none is waiting
+ */
+int nextAsyncResponse(AsyncClient_P client, AsyncResponse_P response);
+
+/*
+ * Closes every connection and frees the client. Requests that were not answered are dropped
+ * without calling their callbacks.
+ *
+ * client - the asynchronous client
+ */
+void closeAsyncClient(AsyncClient_P client);
@@ -0,0 +1,451 @@
+/**	@file TCPclientNIO.java
+ * 	@brief Contains a non-blocking, pipelined TCP client in JAVA built on java.nio.
+ *	One selector thread multiplexes a pool of connections to the TCP Server.
+ *	Requests from any thread are queued on a connection, coalesced into direct ByteBuffer
+ *	writes and matched in order to the responses, so many requests can be in flight
+ *	on each connection at the same time.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+/*
+ * TCPclientNIO.java
+ *
+ * Every call to sendRequest returns a CompletableFuture that is completed by the selector
+ * thread with the server's response. Callbacks attached to the future run on the selector
+ * thread, so long running work should be moved elsewhere with the *Async methods.
+ */
+import java.net.*;
+import java.io.*;
+import java.nio.ByteBuffer;
+import java.nio.channels.*;
+import java.nio.charset.StandardCharsets;
+import java.util.ArrayDeque;
+import java.util.Iterator;
+import java.util.concurrent.*;
+import java.util.concurrent.atomic.AtomicBoolean;
+import java.util.concurrent.atomic.AtomicInteger;
+
+
+public class TCPclientNIO
+{
+	/*
+	* Class Fields
+	*/
+	private static final int BUFFER_SIZE = 64 * 1024; // size of each direct send and receive buffer
+	private static final int MAX_MESSAGE = 256; // size of the server's receive buffer, as in TCPserver.h
+	private static final byte[][] RESPONSE_END = { // closing tags of every response the server sends
+		"</reply>".getBytes(StandardCharsets.US_ASCII),
+		"</replyLoadAvg>".getBytes(StandardCharsets.US_ASCII),
+		"</replyStats>".getBytes(StandardCharsets.US_ASCII),
+		"</error>".getBytes(StandardCharsets.US_ASCII) };
+	private static final byte[] FILE_REPLY_START = "<replyFile length=\"".getBytes(StandardCharsets.US_ASCII); // file replies give their length
+	private static final int FILE_REPLY_END = "</replyFile>".length();
+
+	/*
+	* Instance Fields
+	*/
+	private final Selector selector; // multiplexes every connection in the pool
+	private final Connection[] pool; // the pooled connections to the server
+	private final ConcurrentLinkedQueue<Connection> dirty = new ConcurrentLinkedQueue<Connection>(); // connections with queued requests
+	private final AtomicInteger nextConnection = new AtomicInteger(); // round robin position in the pool
+	private final Thread selectorThread; // runs the selector loop
+	private volatile boolean running = true;
+
+
+	/**
+	 * Constructs a TCPclientNIO object and connects its connection pool to a server.
+	 * The host name is resolved once for the whole pool.
+	 *
+	 * @param host - the ip or hostname of the server
+	 * @param port - the port number of the server
+	 * @param poolSize - the number of connections to open to the server
+	 */
+	public TCPclientNIO(String host, int port, int poolSize) throws IOException
+	{
+		if(poolSize < 1)
+			throw new IllegalArgumentException("The pool needs at least one connection");
+		InetSocketAddress address = new InetSocketAddress(host, port);
+		if(address.isUnresolved())
+			throw new UnknownHostException(host);
+
+		selector = Selector.open();
+		pool = new Connection[poolSize];
+		try{
+			for(int i = 0; i < poolSize; i++)
+				pool[i] = new Connection(address);
+		}
+		catch(IOException ex){
+			for(Connection connection : pool)
+				if(connection != null) connection.fail(ex);
+			selector.close();
+			throw ex;
+		}
+
+		selectorThread = new Thread(this::runSelector, "TCPclientNIO-selector");
+		selectorThread.setDaemon(true);
+		selectorThread.start();
+	}
+
+	/**
+	 * Sends a request for service to the server without waiting for the reply.
+	 * Requests are terminated with a newline if they are not already, so that
+	 * the server can tell pipelined requests apart.
+	 *
+	 * @param request - the request to be sent
+	 *
+	 * @return - a future completed with the server's response, or completed exceptionally
+	 *           if the request is empty, longer than MAX_MESSAGE - 1 bytes or the connection fails
+	 */
+	public CompletableFuture<String> sendRequest(String request)
+	{
+		CompletableFuture<String> future = new CompletableFuture<String>();
+		if(request.length() == 0) { //null message is attempting to be sent to the server - do not send it
+			future.completeExceptionally(new IllegalArgumentException("Cannot Send NULL Message to the Server"));
+			return future;
+		}
+		if(!request.endsWith("\n"))
+			request = request + "\n";
+		byte[] sendBuff = request.getBytes(StandardCharsets.UTF_8);
+		if(sendBuff.length > MAX_MESSAGE - 1) { // the server refuses anything longer, newline included
+			future.completeExceptionally(new IllegalArgumentException("Request is larger than the server accepts"));
+			return future;
+		}
+
+		Connection connection = pool[Math.floorMod(nextConnection.getAndIncrement(), pool.length)];
+		connection.enqueue(new Pending(sendBuff, future));
+		return future;
+	}
+
+	/**
+	 * Sends a request and waits for its response, like TCPclient does.
+	 *
+	 * @param request - the request to be sent
+	 *
+	 * @return - the server's response or NULL if an error occured
+	 */
+	public String request(String request)
+	{
+		try{
+			return sendRequest(request).get();
+		}
+		catch(InterruptedException ex){
+			Thread.currentThread().interrupt();
+			return null;
+		}
+		catch(ExecutionException ex){
+			System.err.println("ERROR: " + ex.getCause().getMessage());
+			return null;
+		}
+	}
+
+	/*
+	 * Prints the response to the screen in a formatted way.
+	 *
+	 * response - the server's response as an XML formatted string
+	 *
+	 */
+	public static void printResponse(String response)
+	{
+		System.out.println("Response from server: " + response);
+	}
+
+	/*
+	 * Closes every connection in the pool. Requests that are still waiting
+	 * for a response are completed exceptionally.
+	 *
+	 * @return - 0, if no error; otherwise, a negative number indicating the error
+	 */
+	public int closeSocket()
+	{
+		running = false;
+		selector.wakeup();
+		try{
+			selectorThread.join();
+			selector.close();
+		}
+		catch(Exception ex){
+			System.err.println("Exception in close");
+			return -1;
+		}
+		return 0;
+	}
+
+
+	/*
+	 * The selector loop. Flushes queued requests, reads responses and keeps going
+	 * until the client is closed.
+	 */
+	private void runSelector()
+	{
+		try{
+			while(running) {
+				selector.select();
+
+				Connection connection;
+				while((connection = dirty.poll()) != null) {
+					connection.dirty.set(false); //cleared before the flush so later requests mark it again
+					connection.flush();
+				}
+
+				Iterator<SelectionKey> keys = selector.selectedKeys().iterator();
+				while(keys.hasNext()) {
+					SelectionKey key = keys.next();
+					keys.remove();
+					connection = (Connection) key.attachment();
+					if(key.isValid() && key.isReadable()) connection.read();
+					if(key.isValid() && key.isWritable()) connection.flush();
+				}
+			}
+		}
+		catch(Exception ex){
+			System.err.println("Exception in selector loop");
+		}
+		finally{
+			running = false;
+			IOException closed = new IOException("Client is closed");
+			for(Connection connection : pool)
+				connection.fail(closed);
+		}
+	}
+
+
+	/*
+	 * A request waiting to be written and the future for its response.
+	 */
+	private static final class Pending
+	{
+		final byte[] data;
+		final CompletableFuture<String> future;
+
+		Pending(byte[] data, CompletableFuture<String> future)
+		{
+			this.data = data;
+			this.future = future;
+		}
+	}
+
+
+	/*
+	 * One pooled connection. Requests are queued by any thread; everything
+	 * else runs on the selector thread.
+	 */
+	private final class Connection
+	{
+		private final SocketChannel channel;
+		private final SelectionKey key;
+		private final ByteBuffer sendBuffer = ByteBuffer.allocateDirect(BUFFER_SIZE); // in fill mode between flushes
+		private ByteBuffer recvBuffer = ByteBuffer.allocateDirect(BUFFER_SIZE); // in fill mode between reads, grown for large file replies
+		private final ConcurrentLinkedQueue<Pending> outbox = new ConcurrentLinkedQueue<Pending>(); // not yet copied to sendBuffer
+		private final ArrayDeque<CompletableFuture<String>> inflight = new ArrayDeque<CompletableFuture<String>>(); // in request order
+		private final AtomicBoolean dirty = new AtomicBoolean();
+		private volatile boolean closed;
+
+		Connection(InetSocketAddress address) throws IOException
+		{
+			channel = SocketChannel.open();
+			try{
+				channel.setOption(StandardSocketOptions.TCP_NODELAY, true);
+				channel.connect(address);
+				channel.configureBlocking(false);
+				key = channel.register(selector, SelectionKey.OP_READ, this);
+			}
+			catch(IOException ex){
+				channel.close();
+				throw ex;
+			}
+		}
+
+		/*
+		 * Queues a request and wakes the selector if the connection was idle.
+		 */
+		void enqueue(Pending pending)
+		{
+			outbox.add(pending);
+			if(closed || !running) {
+				failOutbox(new IOException("Connection is closed"));
+				return;
+			}
+			if(dirty.compareAndSet(false, true)) {
+				TCPclientNIO.this.dirty.add(this);
+				selector.wakeup();
+			}
+		}
+
+		/*
+		 * Copies as many queued requests as fit into the send buffer and writes
+		 * them in one go, until the socket is full or nothing is left.
+		 */
+		void flush()
+		{
+			if(closed) return;
+			try{
+				while(true) {
+					Pending pending;
+					while((pending = outbox.peek()) != null && pending.data.length <= sendBuffer.remaining()) {
+						outbox.poll();
+						sendBuffer.put(pending.data);
+						inflight.add(pending.future);
+					}
+					if(sendBuffer.position() == 0) break;
+					sendBuffer.flip();
+					int written = channel.write(sendBuffer);
+					sendBuffer.compact();
+					if(written == 0) break;
+				}
+				boolean waiting = sendBuffer.position() > 0 || !outbox.isEmpty();
+				key.interestOps(waiting ? SelectionKey.OP_READ | SelectionKey.OP_WRITE : SelectionKey.OP_READ);
+			}
+			catch(IOException ex){
+				fail(ex);
+			}
+		}
+
+		/*
+		 * Reads what the server has sent and completes one future per whole response.
+		 * A response that no request is waiting for fails the connection, and with it
+		 * every request still queued on it.
+		 */
+		void read()
+		{
+			try{
+				if(channel.read(recvBuffer) == -1)
+					throw new EOFException("Server closed the connection");
+				recvBuffer.flip();
+				int length;
+				while((length = responseLength(recvBuffer)) > 0) {
+					byte[] recvBuff = new byte[length];
+					recvBuffer.get(recvBuff);
+					CompletableFuture<String> future = inflight.poll();
+					// a response to nothing means the responses no longer line up with the requests
+					if(future == null)
+						throw new ProtocolException("Response without a request: " + new String(recvBuff, StandardCharsets.UTF_8));
+					future.complete(unescapeResponse(new String(recvBuff, StandardCharsets.UTF_8)));
+				}
+				recvBuffer.compact();
+				if(!recvBuffer.hasRemaining()) {
+					ByteBuffer larger = ByteBuffer.allocateDirect(recvBuffer.capacity() * 2);
+					recvBuffer.flip();
+					larger.put(recvBuffer);
+					recvBuffer = larger;
+				}
+			}
+			catch(IOException ex){
+				fail(ex);
+			}
+		}
+
+		/*
+		 * Closes the connection and fails every request that has not been answered.
+		 */
+		void fail(IOException cause)
+		{
+			closed = true;
+			if(key != null) key.cancel();
+			try{
+				channel.close();
+			}
+			catch(IOException ex){
+			}
+			CompletableFuture<String> future;
+			while((future = inflight.poll()) != null)
+				future.completeExceptionally(cause);
+			failOutbox(cause);
+		}
+
+		private void failOutbox(IOException cause)
+		{
+			Pending pending;
+			while((pending = outbox.poll()) != null)
+				pending.future.completeExceptionally(cause);
+		}
+	}
+
+
+	/*
+	 * Returns the length of the first whole response in the buffer, from its position
+	 * to the end of the first closing tag, or of the file a file reply gives the length of,
+	 * or 0 if no response is complete yet. The server escapes '<' and '&' in echoed text,
+	 * so a message cannot hold a closing tag that would end its reply early.
+	 */
+	private static int responseLength(ByteBuffer buffer)
+	{
+		int start = buffer.position(), limit = buffer.limit();
+		if(limit - start >= FILE_REPLY_START.length) {
+			int i = 0;
+			while(i < FILE_REPLY_START.length && buffer.get(start + i) == FILE_REPLY_START[i]) i++;
+			if(i == FILE_REPLY_START.length) {
+				// the file itself may contain closing tags, so its length decides where the reply ends
+				long fileLength = 0;
+				for(i = start + FILE_REPLY_START.length; i < limit && buffer.get(i) != '>'; i++)
+					if(buffer.get(i) >= '0' && buffer.get(i) <= '9') fileLength = fileLength * 10 + (buffer.get(i) - '0');
+				if(i == limit) return 0;
+				long total = (i + 1 - start) + fileLength + FILE_REPLY_END;
+				return (total <= limit - start) ? (int) total : 0;
+			}
+		}
+		for(int i = start; i + 1 < limit; i++) {
+			if(buffer.get(i) != '<' || buffer.get(i + 1) != '/') continue;
+			for(byte[] tag : RESPONSE_END) {
+				if(i + tag.length > limit) continue;
+				int j = 0;
+				while(j < tag.length && buffer.get(i + j) == tag[j]) j++;
+				if(j == tag.length) return i + tag.length - start;
+			}
+		}
+		return 0;
+	}
+
+	/*
+	 * Turns the escaped text of a <reply> back into the text that was echoed, as
+	 * unescapeResponse in TCPresponse.c does. Other responses are returned as they are.
+	 */
+	private static String unescapeResponse(String response)
+	{
+		if(!response.startsWith("<reply>"))
+			return response;
+		// "&lt;" first, so that an escaped "&" followed by "lt;" stays as it was sent
+		return response.replace("&lt;", "<").replace("&amp;", "&");
+	}
+
+
+	/**
+	 * The main function. Sends the same test messages as TCPclient, all pipelined
+	 * at once, and prints the responses in order.
+	 */
+	public static void main(String[] args)
+	{
+		if (args.length == 2 || args.length == 3){
+
+			final String servName = args[0];
+			final int servPort = Integer.parseInt(args[1]);
+			final int poolSize = (args.length == 3) ? Integer.parseInt(args[2]) : 1;
+			final String[] messages = { "<echo>sfglk</echo>", "", "\n", "<echo>sf\nglk</echo>",
+				"<echo>New Line At End</echo>\n", "<loadavg/>", "<echo>Hello World<echo>", "<echo></echo>" };
+
+			try{
+				TCPclientNIO client = new TCPclientNIO(servName, servPort, poolSize);
+				CompletableFuture<?>[] responses = new CompletableFuture<?>[messages.length];
+				for(int i = 0; i < messages.length; i++)
+					responses[i] = client.sendRequest(messages[i]);
+				for(CompletableFuture<?> response : responses) {
+					try{
+						printResponse((String) response.get());
+					}
+					catch(ExecutionException ex){
+						System.err.println("ERROR: " + ex.getCause().getMessage());
+					}
+				}
+				client.closeSocket();
+			}
+			catch(Exception ex){
+				System.out.println("Socket Stream Failed");
+			}
+		}
+		else {
+			System.out.println("Incorrect Number of Command Line Arguments");
+			System.out.println("java TCPclientNIO <IP Address or Server Host Name> <Port Number> [Pool Size]");
+		}
+	}
+
+}
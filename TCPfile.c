@@ -0,0 +1,347 @@
+/**	@file TCPfile.c
+ * 	@brief Contains the function implementations for serving files from a root directory.
+ *	Files are kept open, and small ones mapped, in a hash table shared by every worker thread. A watcher
+ *	thread reads inotify events for the root directory and drops every file that changes
+ *	from the table; replies that are still sending an old version keep it until they finish.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/inotify.h>
+#include "TCPfile.h"
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	The root directory and every cached file
+ */
+typedef struct FileCache{
+  int rootfd;
+  int inotifyfd;
+  pthread_t watcher;
+  pthread_mutex_t lock;
+  FileEntry_P table[FILE_TABLE_SIZE];
+  int entries;
+  long bytes;
+  unsigned long generation;	//counts the changes seen, so a file opened during a change is not cached
+}FileCache_T, *FileCache_P;
+
+static FileCache_T cache = { -1, -1, 0, PTHREAD_MUTEX_INITIALIZER };
+
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Reads the inotify events of the root directory and drops the files they name.
+*	@param 	no parameter is used.
+*	@return returns a void pointer.
+*/
+void *watch_File_Root( void * param );
+
+/**	@brief 	Drops a file from the cache, or every file if no name is given.
+*	@param 	*name is the name of the changed file, or NULL.
+*	@return returns nothing.
+*/
+void invalidate_File(char *name);
+
+/**	@brief 	Opens a file in the root directory and maps it if it is sent from the mapping;
+*			the kernel reads a larger one ahead for sendfile instead.
+*	@param 	*name is the name of the file.
+*	@return returns the file with one reference, or NULL if it is not a regular file.
+*/
+FileEntry_P map_File(char *name);
+
+/**	@brief 	Closes and unmaps a file nobody uses any more.
+*	@param 	entry is the file.
+*	@return returns nothing.
+*/
+void unmap_File(FileEntry_P entry);
+
+/**	@brief 	Hashes a file name with FNV-1a.
+*	@param 	*name is the file name.
+*	@return returns the slot of the name in the hash table.
+*/
+int file_Slot(char *name);
+
+
+/*
+ **************************************************
+ *		FILE FUNCTIONS
+ **************************************************
+ */
+
+/*
+ **************************************************
+ **************************************************
+ */
+int open_File_Root(char *root){
+  cache.rootfd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if(cache.rootfd == -1) return -1;
+  cache.inotifyfd = inotify_init1(IN_CLOEXEC);
+  if(cache.inotifyfd == -1 || inotify_add_watch(cache.inotifyfd, root, IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF) == -1)
+	return -1;
+  if(pthread_create(&cache.watcher, NULL, watch_File_Root, NULL) != 0) return -1;
+  pthread_detach(cache.watcher);
+  return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+FileEntry_P acquire_File(char *name, int *error){
+  FileEntry_P entry = NULL, found = NULL;
+  unsigned long generation = 0;
+  int slot = 0;
+  *error = FILE_OK;
+  if(cache.rootfd == -1)
+  {
+	*error = FILE_DISABLED;
+	return NULL;
+  }
+  //only files directly inside the root directory, and no hidden ones, can be served
+  if(name[0] == '\0' || name[0] == '.' || strchr(name, '/') != NULL || strlen(name) > FILE_NAME_MAX)
+  {
+	*error = FILE_BAD_NAME;
+	return NULL;
+  }
+
+  slot = file_Slot(name);
+  pthread_mutex_lock(&cache.lock);
+  for(entry = cache.table[slot]; entry != NULL && strcmp(entry->name, name); entry = entry->next);
+  if(entry != NULL) entry->references++;
+  generation = cache.generation;
+  pthread_mutex_unlock(&cache.lock);
+  if(entry != NULL) return entry;
+
+  //open the file without holding the lock, then cache it unless it changed meanwhile
+  entry = map_File(name);
+  if(entry == NULL)
+  {
+	*error = FILE_NOT_FOUND;
+	return NULL;
+  }
+  pthread_mutex_lock(&cache.lock);
+  for(found = cache.table[slot]; found != NULL && strcmp(found->name, name); found = found->next);
+  if(found != NULL)
+  {
+	//another worker cached it first
+	found->references++;
+	pthread_mutex_unlock(&cache.lock);
+	unmap_File(entry);
+	return found;
+  }
+  if(generation == cache.generation && cache.entries < FILE_CACHE_ENTRIES && cache.bytes + entry->size <= FILE_CACHE_BYTES)
+  {
+	entry->references++;
+	entry->next = cache.table[slot];
+	cache.table[slot] = entry;
+	cache.entries++;
+	cache.bytes += entry->size;
+  }
+  pthread_mutex_unlock(&cache.lock);
+  return entry;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void release_File(FileEntry_P entry){
+  int unused = 0;
+  pthread_mutex_lock(&cache.lock);
+  unused = (--entry->references == 0);
+  pthread_mutex_unlock(&cache.lock);
+  if(unused) unmap_File(entry);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int send_File(int sockfd, FileEntry_P entry, off_t *offset){
+  ssize_t byteSentCount = 0;
+  while(*offset < entry->size)
+  {
+	//small files go out in one send from the mapping, large ones without touching user space
+	if(entry->size < FILE_SENDFILE_MIN)
+		byteSentCount = send(sockfd, entry->data + *offset, entry->size - *offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+	else
+		byteSentCount = sendfile(sockfd, entry->fd, offset, entry->size - *offset);
+	if(byteSentCount == -1)
+	{
+		if(errno == EINTR) continue;
+		if(errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+		return -1;
+	}
+	//the file was truncated underneath us, so the promised length cannot be kept
+	if(byteSentCount == 0) return -1;
+	if(entry->size < FILE_SENDFILE_MIN) *offset += byteSentCount;
+  }
+  return 1;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void *watch_File_Root( void * param ){
+  char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  struct inotify_event *event = NULL;
+  ssize_t length = 0;
+  char *next = NULL;
+  while(1)
+  {
+	length = read(cache.inotifyfd, events, sizeof(events));
+	if(length == -1 && errno == EINTR) continue;
+	if(length <= 0) break;
+	for(next = events; next < events + length; next += sizeof(struct inotify_event) + event->len)
+	{
+		event = (struct inotify_event *) next;
+		//lost events or a root directory that moved leave no way to tell what changed
+		if((event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF)) || event->len == 0)
+			invalidate_File(NULL);
+		else
+			invalidate_File(event->name);
+	}
+  }
+  return NULL;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void invalidate_File(char *name){
+  FileEntry_P *link = NULL, entry = NULL, unused = NULL;
+  int slot = 0, last = FILE_TABLE_SIZE;
+  pthread_mutex_lock(&cache.lock);
+  cache.generation++;
+  if(name != NULL)
+  {
+	slot = file_Slot(name);
+	last = slot + 1;
+  }
+  for(; slot < last; slot++)
+  {
+	link = &cache.table[slot];
+	while(*link != NULL)
+	{
+		entry = *link;
+		if(name != NULL && strcmp(entry->name, name))
+		{
+			link = &entry->next;
+			continue;
+		}
+		*link = entry->next;
+		cache.entries--;
+		cache.bytes -= entry->size;
+		//entries still being sent are unmapped by their last release_File
+		if(--entry->references == 0)
+		{
+			entry->next = unused;
+			unused = entry;
+		}
+	}
+  }
+  pthread_mutex_unlock(&cache.lock);
+  while(unused != NULL)
+  {
+	entry = unused;
+	unused = entry->next;
+	unmap_File(entry);
+  }
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+FileEntry_P map_File(char *name){
+  FileEntry_P entry = NULL;
+  struct stat info;
+  int fd = openat(cache.rootfd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if(fd == -1) return NULL;
+  if(fstat(fd, &info) == -1 || !S_ISREG(info.st_mode))
+  {
+	close(fd);
+	return NULL;
+  }
+  entry = (FileEntry_P) calloc(1, sizeof(FileEntry_T));
+  if(entry == NULL)
+  {
+	close(fd);
+	return NULL;
+  }
+  strcpy(entry->name, name);
+  entry->fd = fd;
+  entry->size = info.st_size;
+  entry->references = 1;
+  //only files sent from the mapping are mapped; sendfile reads the rest through the descriptor
+  if(entry->size > 0 && entry->size < FILE_SENDFILE_MIN)
+  {
+	entry->data = mmap(NULL, entry->size, PROT_READ, MAP_SHARED, fd, 0);
+	if(entry->data == MAP_FAILED)
+	{
+		close(fd);
+		free(entry);
+		return NULL;
+	}
+	madvise(entry->data, entry->size, MADV_WILLNEED);
+  }
+  else if(entry->size > 0) posix_fadvise(fd, 0, entry->size, POSIX_FADV_WILLNEED);
+  return entry;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void unmap_File(FileEntry_P entry){
+  if(entry->data != NULL) munmap(entry->data, entry->size);
+  close(entry->fd);
+  free(entry);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int file_Slot(char *name){
+  uint32_t hash = 2166136261U;
+  while(*name != '\0')
+  {
+	hash ^= (unsigned char) *name++;
+	hash *= 16777619U;
+  }
+  return hash % FILE_TABLE_SIZE;
+}
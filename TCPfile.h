@@ -0,0 +1,94 @@
+/**	@file TCPfile.h
+ * 	@brief Contains the function prototypes for serving files from a root directory, implemented
+ *	in TCPfile.c
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+/*
+ * TCPfile.h
+ *
+ * Files are served from the files directly inside a single root directory. Every file that
+ * is asked for is opened once and kept in a cache until inotify reports that it has changed.
+ * Small files are mapped and sent straight from the mapping, larger ones are only kept open
+ * and sent with sendfile, so the bytes of a file are never copied through a user space buffer.
+ *
+ * A reply to <get-file>name</get-file> is <replyFile length="N"> followed by the N bytes of
+ * the file and </replyFile>, so the file may contain anything, closing tags included.
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ **************************************************
+ *		COMPILER PRE DEFINES
+ **************************************************
+ */
+
+#define FILE_TABLE_SIZE 256
+#define FILE_CACHE_ENTRIES 1024
+#define FILE_CACHE_BYTES (256L * 1024 * 1024)
+#define FILE_SENDFILE_MIN (16 * 1024)
+#define FILE_NAME_MAX 255
+#define FILE_OK 0
+#define FILE_DISABLED -1
+#define FILE_BAD_NAME -2
+#define FILE_NOT_FOUND -3
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	A file that is open, and mapped if it is small. It stays valid until every user has released it,
+ *	even when it has been dropped from the cache in the meantime.
+ */
+typedef struct FileEntry{
+  char name[FILE_NAME_MAX + 1];
+  int fd;
+  char *data;	//the mapped file, NULL for an empty file or one of FILE_SENDFILE_MIN bytes or more
+  off_t size;
+  int references;	//the cache holds one while the entry is in it, every reply being sent another
+  struct FileEntry *next;
+}FileEntry_T, *FileEntry_P;
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Opens the root directory and starts watching it for changes. Until this is called
+*			every request for a file is refused.
+*	@param 	*root is the path of the directory the files are served from.
+*	@return returns 0, or -1 if the directory cannot be opened or watched.
+*/
+int open_File_Root(char *root);
+
+/**	@brief 	Finds a file in the cache, or opens it, maps it if it is small and adds it to the cache.
+*	@param 	*name is the name of the file inside the root directory. Names containing '/' or
+*			starting with '.' are refused, so nothing outside the root directory can be reached.
+*			*error is set to FILE_DISABLED, FILE_BAD_NAME or FILE_NOT_FOUND if there is no file.
+*	@return returns the file, which must be given back with release_File, or NULL.
+*/
+FileEntry_P acquire_File(char *name, int *error);
+
+/**	@brief 	Gives back a file from acquire_File. The file is closed and unmapped once
+*			nobody uses it and it is no longer in the cache.
+*	@param 	entry is the file.
+*	@return returns nothing.
+*/
+void release_File(FileEntry_P entry);
+
+/**	@brief 	Sends as much of a file as the socket takes without waiting.
+*	@param 	sockfd is the connected stream socket.
+*			entry is the file.
+*			*offset is how much of the file has been sent and is moved past what this call sends.
+*	@return returns 1 once the whole file is sent, 0 if the socket is full and -1 if the
+*			connection failed or the file shrank while it was being sent.
+*/
+int send_File(int sockfd, FileEntry_P entry, off_t *offset);
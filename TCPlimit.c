@@ -0,0 +1,162 @@
+/**	@file TCPlimit.c
+ * 	@brief Contains the function implementations for limiting how many requests each client
+ *	address may send per second. The token buckets live in a hash table that is shared by
+ *	every worker thread and locked in stripes, so workers rarely wait on each other.
+ *	Buckets of addresses that have been idle for RATE_IDLE_SECONDS are freed as they are found.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+#include "TCPlimit.h"
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	The token bucket of one client address
+ */
+typedef struct RateBucket{
+  uint64_t key;
+  double tokens;
+  double last;	//seconds when the bucket was last filled
+  struct RateBucket *next;
+}RateBucket_T, *RateBucket_P;
+
+/*
+ *	The configured limit and every bucket
+ */
+typedef struct RateLimit{
+  double rate;
+  double burst;
+  RateBucket_P table[RATE_TABLE_SIZE];
+  pthread_mutex_t locks[RATE_LOCKS];
+}RateLimit_T, *RateLimit_P;
+
+static RateLimit_T limit;
+
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Returns the time in seconds on the monotonic clock.
+*	@param 	no parameter is passed.
+*	@return returns the time in seconds.
+*/
+double rate_Clock(void);
+
+
+/*
+ **************************************************
+ *		RATE LIMIT FUNCTIONS
+ **************************************************
+ */
+
+/*
+ **************************************************
+ **************************************************
+ */
+void configure_Rate_Limit(double rate, double burst){
+  int i = 0;
+  limit.rate = (rate > 0.0) ? rate : 0.0;
+  limit.burst = (burst >= 1.0) ? burst : 1.0;
+  for(i = 0; i < RATE_LOCKS; i++)
+	pthread_mutex_init(&limit.locks[i], NULL);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+uint64_t rate_Key(struct sockaddr_storage *clientaddr, int confd){
+  struct ucred credentials;
+  socklen_t length = sizeof(credentials);
+  if(clientaddr->ss_family == AF_INET)
+	return ((uint64_t) AF_INET << 32) | ((struct sockaddr_in *) clientaddr)->sin_addr.s_addr;
+  if(clientaddr->ss_family == AF_UNIX && getsockopt(confd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0)
+	return ((uint64_t) AF_UNIX << 32) | credentials.uid;
+  return (uint64_t) clientaddr->ss_family << 32;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int take_Rate_Token(uint64_t key, long *waitMs){
+  RateBucket_P *link, bucket = NULL;
+  double now = 0.0;
+  int slot = 0, allowed = 1;
+  if(limit.rate == 0.0) return 1;
+
+  slot = (int) ((key * 0x9E3779B97F4A7C15ULL) >> 52) % RATE_TABLE_SIZE;
+  now = rate_Clock();
+  pthread_mutex_lock(&limit.locks[slot % RATE_LOCKS]);
+  link = &limit.table[slot];
+  while(*link != NULL)
+  {
+	if((*link)->key == key) bucket = *link;
+	//drop buckets nobody has used for a while; they would be full again anyway
+	else if(now - (*link)->last > RATE_IDLE_SECONDS)
+	{
+		RateBucket_P idle = *link;
+		*link = idle->next;
+		free(idle);
+		continue;
+	}
+	link = &(*link)->next;
+  }
+  if(bucket == NULL)
+  {
+	bucket = (RateBucket_P) malloc(sizeof(RateBucket_T));
+	if(bucket == NULL)
+	{
+		//without memory for a bucket the client is served rather than stalled
+		pthread_mutex_unlock(&limit.locks[slot % RATE_LOCKS]);
+		return 1;
+	}
+	bucket->key = key;
+	bucket->tokens = limit.burst;
+	bucket->last = now;
+	bucket->next = limit.table[slot];
+	limit.table[slot] = bucket;
+  }
+
+  bucket->tokens += (now - bucket->last) * limit.rate;
+  if(bucket->tokens > limit.burst) bucket->tokens = limit.burst;
+  bucket->last = now;
+  if(bucket->tokens >= 1.0)
+	bucket->tokens -= 1.0;
+  else
+  {
+	allowed = 0;
+	*waitMs = (long) ((1.0 - bucket->tokens) / limit.rate * 1000.0) + 1;
+  }
+  pthread_mutex_unlock(&limit.locks[slot % RATE_LOCKS]);
+  return allowed;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+double rate_Clock(void){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
@@ -0,0 +1,56 @@
+/**	@file TCPlimit.h
+ * 	@brief Contains the function prototypes for limiting how many requests each client address
+ *	may send per second, implemented in TCPlimit.c
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+/*
+ * TCPlimit.h
+ *
+ * Every client address gets a token bucket that fills at the configured rate up to the
+ * burst size. A request takes one token; a client whose bucket is empty has to wait until
+ * the next token is due. TCP clients are keyed by their IP address and local clients by
+ * the user id they run as, so opening more connections does not raise the limit.
+ */
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+/*
+ **************************************************
+ *		COMPILER PRE DEFINES
+ **************************************************
+ */
+
+#define RATE_TABLE_SIZE 4096
+#define RATE_LOCKS 64
+#define RATE_IDLE_SECONDS 60
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Sets the rate limit for every client address. Must be called before any client is served.
+*	@param 	rate is the number of requests per second allowed per client address, 0 for no limit.
+*			burst is the number of requests a client address may send at once; at least 1.
+*	@return returns nothing.
+*/
+void configure_Rate_Limit(double rate, double burst);
+
+/**	@brief 	Works out which token bucket a client belongs to.
+*	@param 	*clientaddr is the client's address as returned by accept.
+*			confd is the client's socket, used to find the user id of local clients.
+*	@return returns the key of the client's token bucket.
+*/
+uint64_t rate_Key(struct sockaddr_storage *clientaddr, int confd);
+
+/**	@brief 	Takes a token from a client's bucket for one request.
+*	@param 	key is the client's key from rate_Key.
+*			*waitMs is set to the milliseconds until the next token is due if the bucket is empty.
+*	@return returns 1 if the request may be served now, 0 if the client has to wait.
+*/
+int take_Rate_Token(uint64_t key, long *waitMs);
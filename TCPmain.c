@@ -8,7 +8,7 @@
  */
 
  
-#include "TCPclient.h"
+#include "TCPclientAsync.h"
 
 
 /**	@brief 	Used for testing purposes to test the TCP Client in C. 
@@ -19,19 +19,49 @@
 *	@return returns nothing. 
 */
 void sendMessageTest( char * message, struct sockaddr_in *servDest, int sockfd, char *response );
+
+/**	@brief 	Used for testing purposes to test the asynchronous TCP Client in C. 
+*			Queues every message on the server at once and prints the responses in order. 
+*	@param 	*serverName is the IP address or host name of the server.
+			port is the port number of the server.
+			**messages are the messages to send to the server.
+			count is the number of messages. 
+*	@return returns nothing. 
+*/
+void sendAsyncMessageTest( char * serverName, int port, char ** messages, int count );
+
+/**	@brief 	Used for testing purposes to fetch a file from the server's root directory. 
+*			Prints the size of the file and how fast it arrived. 
+*	@param 	*name is the name of the file.
+			sockfd is the socket of a stream connection to the server. 
+*	@return returns nothing. 
+*/
+void requestFileTest( char * name, int sockfd );
  
  
 /**	@brief 	The main program for running the TCP client.
-*	@param 	no parameters. 
+*	@param 	argv[1] is the server's IP address or host name and argv[2] its port number. 
+*			The optional argv[3] is a file to fetch instead of running the tests. 
 *	@return returns 0 to the OS when main completes. 
 */
 int main(int argc, char**argv)
 {
-	if(argc == 3)
+	if(argc == 4)
+	{
+		struct sockaddr_in servDest;
+		int sockfd = createSocket(argv[1], atoi(argv[2]), (&servDest));
+		if( sockfd != -1)
+		{
+			requestFileTest(argv[3], sockfd);
+			closeSocket(sockfd);
+		}
+	}
+	else if(argc == 3)
 	{
 		struct sockaddr_in servDest;
 		int sockfd = -1;
-		char response[MAX_MESSAGE];
+		char response[MAX_RESPONSE];
+		char * messages[] = { "<echo>HelloWorld</echo>", "<echo>sfglk</echo>", "", "\n", "<loadavg/>", "<echo> Hello World <echo>", "<echo></echo>" };
 		
 		sockfd = createSocket(argv[1], atoi(argv[2]), (&servDest));   //create the TCP socket 
 		if( sockfd != -1)
@@ -47,12 +77,14 @@ int main(int argc, char**argv)
 			sendMessageTest("<echo></echo>", &servDest, sockfd, response);
 			
 			closeSocket(sockfd); //close the socket
+
+			sendAsyncMessageTest(argv[1], atoi(argv[2]), messages, sizeof(messages) / sizeof(messages[0]));
 		}
 	}
 	else
 	{
 		printf("Incorrect Number of Command Line Arguments\n");
-		printf("./c_client <IP Address or Server Host Name> <Port Number>\n");
+		printf("./c_client <IP Address or Server Host Name> <Port Number> [File Name]\n");
 	}
 
 	return 0;
@@ -71,4 +103,55 @@ void sendMessageTest( char * message, struct sockaddr_in *servDest, int sockfd,
 
  
 
- 
\ No newline at end of file
+ 
+
+/*
+ **************************************************
+ **************************************************
+ */
+void sendAsyncMessageTest( char * serverName, int port, char ** messages, int count ){ 
+	AsyncResponse_T response;
+	int server = -1, i = 0;
+	AsyncClient_P client = createAsyncClient();
+	if(client == NULL) return;
+
+	server = addAsyncServer(client, serverName, port, 1); //open the connection pool
+	if(server != -1)
+	{
+		for(i = 0; i < count; i++) 
+			if(sendAsyncRequest(client, server, messages[i], NULL, NULL) == -1) //queue a request
+				fprintf(stderr, "ERROR: Cannot Queue Message %d for the Server\n", i);
+		waitAsyncClient(client); //write the queued requests together and wait for every response
+		while(nextAsyncResponse(client, &response)) 
+		{
+			if(response.status == 0) printResponse(response.response); //print the response from the server
+			free(response.response);
+		}
+	}
+	closeAsyncClient(client);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void requestFileTest( char * name, int sockfd ){ 
+	struct timespec start, end;
+	char * contents = NULL;
+	long length = 0;
+	double seconds = 0.0;
+	int error = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	error = requestFile(sockfd, name, &contents, &length); //fetch the whole file
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if(error == -2) printf("Server has no file %s to give\n", name);
+	else if(error != 0) printf("Cannot Fetch %s from the Server\n", name);
+	else
+	{
+		seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+		printf("Received %s : %ld bytes in %.3f ms (%.1f MB/s)\n", name, length, seconds * 1000.0, seconds > 0.0 ? length / seconds / 1000000.0 : 0.0);
+	}
+	free(contents);
+}
@@ -0,0 +1,711 @@
+/**	@file TCPproxy.c
+ * 	@brief Contains the function implementations for forwarding requests to backend servers.
+ *	The backends and the hash ring are shared by every worker thread and only change when a
+ *	backend goes down or comes back. Each worker owns a ProxyPool with its own connection to
+ *	every backend, so forwarding and reading replies never lock.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "TCPproxy.h"
+#include "TCPresponse.h"
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	A backend server
+ */
+typedef struct Backend{
+  char name[PROXY_MAX_REQUEST];
+  struct sockaddr_storage address;
+  socklen_t addressLength;
+  long long downUntil;	//milliseconds until which the backend is skipped, 0 while it is up
+}Backend_T, *Backend_P;
+
+/*
+ *	A point of a backend on the hash ring
+ */
+typedef struct RingPoint{
+  uint32_t hash;
+  int backend;
+}RingPoint_T, *RingPoint_P;
+
+/*
+ *	Every backend and the ring, shared by all workers
+ */
+typedef struct Proxy{
+  Backend_T backends[PROXY_MAX_BACKENDS];
+  int count;
+  RingPoint_T ring[PROXY_MAX_BACKENDS * PROXY_VIRTUAL_NODES];
+  int points;
+  unsigned long forwarded;
+  unsigned long failovers;	//requests sent again because their backend failed
+}Proxy_T, *Proxy_P;
+
+/*
+ *	A worker's connection to one backend
+ */
+typedef struct ProxyConnection{
+  int kind;	//always EVENT_BACKEND, so an epoll event can tell a backend from a client
+  int backend;
+  int fd;	//-1 while closed
+  int connected;
+  uint32_t events;
+  char *output;	//requests not written yet
+  int outputLength;
+  int outputSent;
+  int outputCapacity;
+  char *input;	//replies not complete yet
+  int inputLength;
+  int inputCapacity;
+  ProxySlot_P sentHead;	//requests waiting for their replies, in the order they were sent
+  ProxySlot_P sentTail;
+  long long lastActivity;
+  ProxySlot_T probe;	//the health check, in flight while on the sent list
+  struct ProxyPool *pool;
+}ProxyConnection_T, *ProxyConnection_P;
+
+/*
+ *	A worker's connections
+ */
+struct ProxyPool{
+  int epollfd;
+  ProxyDeliver deliver;
+  ProxyConnection_T connections[PROXY_MAX_BACKENDS];
+  int next;	//the next backend for round robin requests
+  long long lastCheck;
+};
+
+static Proxy_T proxy;
+
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Looks up the address of a backend given as host:port or as a local socket path.
+*	@param 	backend is filled in with the name and the address.
+*			*name is the backend as given on the command line.
+*	@return returns 0, or -1 if the backend cannot be found.
+*/
+int resolve_Backend(Backend_P backend, char *name);
+
+/**	@brief 	Orders two ring points by their hash for qsort.
+*	@param 	*first and *second are the ring points.
+*	@return returns a negative number, zero or a positive number like strcmp.
+*/
+int compare_Points(const void *first, const void *second);
+
+/**	@brief 	Hashes bytes with FNV-1a and mixes the bits of the result.
+*	@param 	*data are the bytes and length their number.
+*	@return returns the hash.
+*/
+uint32_t fnv_Hash(char *data, int length);
+
+/**	@brief 	Tells whether a backend is up for every worker.
+*	@param 	backend is the index of the backend.
+*			now is the time in milliseconds.
+*	@return returns non zero if the backend may be used.
+*/
+int backend_Up(int backend, long long now);
+
+/**	@brief 	Picks the backend of a request: the first backend that is up clockwise from the
+*			request's hash, or the next one in turn for round robin requests.
+*	@param 	pool is the worker's pool.
+*			slot is the request.
+*			now is the time in milliseconds.
+*	@return returns the index of the backend, or -1 if none is up.
+*/
+int pick_Backend(ProxyPool_P pool, ProxySlot_P slot, long long now);
+
+/**	@brief 	Queues a request on the connection of its backend, or fails it if no backend is up.
+*	@param 	pool is the worker's pool.
+*			slot is the request.
+*	@return returns nothing.
+*/
+void dispatch_Slot(ProxyPool_P pool, ProxySlot_P slot);
+
+/**	@brief 	Finishes a request with an error reply.
+*	@param 	pool is the worker's pool.
+*			slot is the request.
+*			*error is the error reply.
+*	@return returns nothing.
+*/
+void fail_Slot(ProxyPool_P pool, ProxySlot_P slot, char *error);
+
+/**	@brief 	Opens a non-blocking connection to a backend and adds it to the worker's epoll set.
+*	@param 	connection is the connection.
+*	@return returns 0, or -1 if the backend refused it at once.
+*/
+int connect_Backend(ProxyConnection_P connection);
+
+/**	@brief 	Closes a connection, marks its backend down and sends its requests again elsewhere.
+*	@param 	connection is the connection.
+*	@return returns nothing.
+*/
+void fail_Connection(ProxyConnection_P connection);
+
+/**	@brief 	Adds a request to a connection's output and to the requests waiting for a reply.
+*	@param 	connection is the connection.
+*			slot is the request.
+*			now is the time in milliseconds.
+*	@return returns 0, or -1 if there is not enough memory.
+*/
+int queue_Slot(ProxyConnection_P connection, ProxySlot_P slot, long long now);
+
+/**	@brief 	Writes as much of a connection's output as the socket takes without waiting.
+*	@param 	connection is the connection.
+*	@return returns nothing.
+*/
+void write_Connection(ProxyConnection_P connection);
+
+/**	@brief 	Reads the replies that have arrived on a connection and delivers them.
+*	@param 	connection is the connection.
+*	@return returns nothing.
+*/
+void read_Connection(ProxyConnection_P connection);
+
+/**	@brief 	Changes the epoll events watched for a connection.
+*	@param 	connection is the connection.
+*			events are the epoll events to watch.
+*	@return returns nothing.
+*/
+void watch_Connection(ProxyConnection_P connection, uint32_t events);
+
+/**	@brief 	Returns the time in milliseconds on the monotonic clock.
+*	@param 	no parameter is passed.
+*	@return returns the time in milliseconds.
+*/
+long long proxy_Clock(void);
+
+
+/*
+ **************************************************
+ *		PROXY FUNCTIONS
+ **************************************************
+ */
+
+/*
+ **************************************************
+ **************************************************
+ */
+int configure_Proxy(char *backends){
+  char *list = strdup(backends), *name = NULL, *rest = NULL, point[PROXY_MAX_REQUEST + 16];
+  int i = 0, j = 0;
+  if(list == NULL) return -1;
+  for(name = strtok_r(list, ",", &rest); name != NULL; name = strtok_r(NULL, ",", &rest))
+  {
+	if(proxy.count == PROXY_MAX_BACKENDS || resolve_Backend(&proxy.backends[proxy.count], name) == -1)
+	{
+		free(list);
+		return -1;
+	}
+	proxy.count++;
+  }
+  free(list);
+
+  //every backend gets its points on the ring from its name, so every proxy builds the same ring
+  for(i = 0; i < proxy.count; i++)
+	for(j = 0; j < PROXY_VIRTUAL_NODES; j++)
+	{
+		snprintf(point, sizeof(point), "%s#%d", proxy.backends[i].name, j);
+		proxy.ring[proxy.points].hash = fnv_Hash(point, strlen(point));
+		proxy.ring[proxy.points++].backend = i;
+	}
+  qsort(proxy.ring, proxy.points, sizeof(RingPoint_T), compare_Points);
+  return (proxy.count > 0) ? proxy.count : -1;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+ProxyPool_P create_Proxy_Pool(int epollfd, ProxyDeliver deliver){
+  ProxyPool_P pool = NULL;
+  int i = 0;
+  if(proxy.count == 0) return NULL;
+  pool = (ProxyPool_P) calloc(1, sizeof(ProxyPool_T));
+  if(pool == NULL) return NULL;
+  pool->epollfd = epollfd;
+  pool->deliver = deliver;
+  pool->lastCheck = proxy_Clock();
+  for(i = 0; i < proxy.count; i++)
+  {
+	pool->connections[i].kind = EVENT_BACKEND;
+	pool->connections[i].backend = i;
+	pool->connections[i].fd = -1;
+	pool->connections[i].pool = pool;
+	connect_Backend(&pool->connections[i]);
+  }
+  return pool;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void proxy_Forward(ProxyPool_P pool, ProxySlot_P slot, char *request, int length){
+  if(length > PROXY_MAX_REQUEST) length = PROXY_MAX_REQUEST;
+  memcpy(slot->request, request, length);
+  slot->requestLength = length;
+  //backends tell pipelined requests apart by their newlines
+  if(length > 0 && request[length - 1] == '\n') length--;
+  else slot->request[slot->requestLength++] = '\n';
+  slot->hash = fnv_Hash(request, length);
+  slot->roundRobin = (length >= 10 && !strncmp(request, "<loadavg/>", 10));
+  slot->retries = 0;
+  dispatch_Slot(pool, slot);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void proxy_Event(ProxyPool_P pool, void *data, uint32_t events){
+  ProxyConnection_P connection = (ProxyConnection_P) data;
+  int error = 0;
+  socklen_t errorLength = sizeof(error);
+  if(connection->fd == -1) return;
+  if(!connection->connected)
+  {
+	//a connection that was still being set up has either failed or is ready
+	if(getsockopt(connection->fd, SOL_SOCKET, SO_ERROR, &error, &errorLength) == -1 || error != 0)
+	{
+		fail_Connection(connection);
+		return;
+	}
+	connection->connected = 1;
+	connection->lastActivity = proxy_Clock();
+	__atomic_store_n(&proxy.backends[connection->backend].downUntil, 0, __ATOMIC_RELAXED);
+  }
+  if(events & (EPOLLIN | EPOLLHUP | EPOLLERR)) read_Connection(connection);
+  if(connection->fd != -1) write_Connection(connection);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void proxy_Flush(ProxyPool_P pool){
+  int i = 0;
+  for(i = 0; i < proxy.count; i++)
+	if(pool->connections[i].connected && pool->connections[i].outputSent < pool->connections[i].outputLength)
+		write_Connection(&pool->connections[i]);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int proxy_Check(ProxyPool_P pool){
+  ProxyConnection_P connection = NULL;
+  long long now = proxy_Clock(), waited = 0;
+  int i = 0;
+  if(now - pool->lastCheck < PROXY_CHECK_MS) return (int) (PROXY_CHECK_MS - (now - pool->lastCheck));
+  pool->lastCheck = now;
+  for(i = 0; i < proxy.count; i++)
+  {
+	connection = &pool->connections[i];
+	if(connection->fd == -1)
+	{
+		//a backend is tried again once its time is up, before any request depends on it
+		if(backend_Up(i, now)) connect_Backend(connection);
+		continue;
+	}
+	//a backend that sends nothing for too long while owing replies, or never accepts, is taken as dead
+	waited = now - connection->lastActivity;
+	if(connection->sentHead != NULL && connection->sentHead->sentAt > connection->lastActivity)
+		waited = now - connection->sentHead->sentAt;
+	if((connection->sentHead != NULL || !connection->connected) && waited > PROXY_TIMEOUT_MS)
+		fail_Connection(connection);
+	else if(connection->connected && connection->sentHead == NULL && waited > PROXY_PROBE_MS)
+	{
+		memcpy(connection->probe.request, "<loadavg/>\n", 11);
+		connection->probe.requestLength = 11;
+		if(queue_Slot(connection, &connection->probe, now) == 0) write_Connection(connection);
+	}
+  }
+  return PROXY_CHECK_MS;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void proxy_Stats(char *buffer){
+  long long now = proxy_Clock();
+  int i = 0, up = 0;
+  for(i = 0; i < proxy.count; i++)
+	if(backend_Up(i, now)) up++;
+  sprintf(buffer, " backends=%d up=%d forwarded=%lu failovers=%lu", proxy.count, up, proxy.forwarded, proxy.failovers);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int resolve_Backend(Backend_P backend, char *name){
+  struct sockaddr_un *local = (struct sockaddr_un *) &backend->address;
+  struct addrinfo hints, *result = NULL;
+  char host[PROXY_MAX_REQUEST], *port = NULL;
+  if(strlen(name) >= PROXY_MAX_REQUEST) return -1;
+  strcpy(backend->name, name);
+
+  //local backends are named like local servers are named to the clients
+  if(!strncmp(name, "unix:", 5)) name += 5;
+  if(name[0] == '/')
+  {
+	if(strlen(name) >= sizeof(local->sun_path)) return -1;
+	local->sun_family = AF_UNIX;
+	strcpy(local->sun_path, name);
+	backend->addressLength = sizeof(struct sockaddr_un);
+	return 0;
+  }
+
+  strcpy(host, name);
+  port = strrchr(host, ':');
+  if(port == NULL) return -1;
+  *port++ = '\0';
+  memset((void *) &hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if(getaddrinfo(host, port, &hints, &result) != 0) return -1;
+  memcpy(&backend->address, result->ai_addr, result->ai_addrlen);
+  backend->addressLength = result->ai_addrlen;
+  freeaddrinfo(result);
+  return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int compare_Points(const void *first, const void *second){
+  uint32_t a = ((RingPoint_P) first)->hash, b = ((RingPoint_P) second)->hash;
+  return (a > b) - (a < b);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+uint32_t fnv_Hash(char *data, int length){
+  uint32_t hash = 2166136261U;
+  int i = 0;
+  for(i = 0; i < length; i++)
+  {
+	hash ^= (unsigned char) data[i];
+	hash *= 16777619U;
+  }
+  //keys that differ only in their last bytes would otherwise land close together on the ring
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bU;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35U;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int backend_Up(int backend, long long now){
+  return __atomic_load_n(&proxy.backends[backend].downUntil, __ATOMIC_RELAXED) <= now;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int pick_Backend(ProxyPool_P pool, ProxySlot_P slot, long long now){
+  int low = 0, high = proxy.points, middle = 0, i = 0, backend = 0;
+  if(slot->roundRobin)
+  {
+	for(i = 0; i < proxy.count; i++)
+	{
+		backend = pool->next;
+		pool->next = (pool->next + 1) % proxy.count;
+		if(backend_Up(backend, now)) return backend;
+	}
+	return -1;
+  }
+
+  //the first point at or after the request's hash, wrapping around the ring
+  while(low < high)
+  {
+	middle = (low + high) / 2;
+	if(proxy.ring[middle].hash < slot->hash) low = middle + 1;
+	else high = middle;
+  }
+  for(i = 0; i < proxy.points; i++)
+  {
+	backend = proxy.ring[(low + i) % proxy.points].backend;
+	if(backend_Up(backend, now)) return backend;
+  }
+  return -1;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void dispatch_Slot(ProxyPool_P pool, ProxySlot_P slot){
+  ProxyConnection_P connection = NULL;
+  long long now = proxy_Clock();
+  int backend = -1, tries = 0;
+  for(tries = 0; tries < proxy.count; tries++)
+  {
+	backend = pick_Backend(pool, slot, now);
+	if(backend == -1) break;
+	connection = &pool->connections[backend];
+	//a backend that refuses at once is marked down, and the next one on the ring is tried
+	if(connection->fd == -1 && connect_Backend(connection) == -1) continue;
+	if(queue_Slot(connection, slot, now) == -1) break;
+	__sync_fetch_and_add(&proxy.forwarded, 1);
+	return;
+  }
+  fail_Slot(pool, slot, "<error>no backend available</error>");
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void fail_Slot(ProxyPool_P pool, ProxySlot_P slot, char *error){
+  slot->done = 1;
+  pool->deliver(slot, error, strlen(error));
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int connect_Backend(ProxyConnection_P connection){
+  Backend_P backend = &proxy.backends[connection->backend];
+  struct epoll_event event;
+  int noDelay = 1;
+  connection->fd = socket(backend->address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(connection->fd == -1)
+  {
+	fail_Connection(connection);
+	return -1;
+  }
+  if(backend->address.ss_family == AF_INET)
+	setsockopt(connection->fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  connection->connected = 0;
+  connection->lastActivity = proxy_Clock();
+  if(connect(connection->fd, (struct sockaddr *) &backend->address, backend->addressLength) == 0)
+	connection->connected = 1;
+  else if(errno != EINPROGRESS && errno != EAGAIN)
+  {
+	fail_Connection(connection);
+	return -1;
+  }
+  //the connection is ready to use once it is writable
+  connection->events = EPOLLIN | EPOLLOUT;
+  event.events = connection->events;
+  event.data.ptr = connection;
+  if(epoll_ctl(connection->pool->epollfd, EPOLL_CTL_ADD, connection->fd, &event) == -1)
+  {
+	fail_Connection(connection);
+	return -1;
+  }
+  return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void fail_Connection(ProxyConnection_P connection){
+  ProxySlot_P slot = connection->sentHead, next = NULL;
+  if(connection->fd != -1) close(connection->fd);
+  connection->fd = -1;
+  connection->connected = 0;
+  connection->outputLength = connection->outputSent = 0;
+  connection->inputLength = 0;
+  connection->sentHead = connection->sentTail = NULL;
+  __atomic_store_n(&proxy.backends[connection->backend].downUntil, proxy_Clock() + PROXY_RETRY_MS, __ATOMIC_RELAXED);
+
+  //the requests it owed replies for go to the next backend up on the ring
+  for(; slot != NULL; slot = next)
+  {
+	next = slot->nextSent;
+	slot->nextSent = NULL;
+	if(slot == &connection->probe) continue;
+	if(slot->owner != NULL && slot->retries < PROXY_MAX_RETRIES)
+	{
+		slot->retries++;
+		__sync_fetch_and_add(&proxy.failovers, 1);
+		dispatch_Slot(connection->pool, slot);
+	}
+	else
+		fail_Slot(connection->pool, slot, "<error>backend unavailable</error>");
+  }
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int queue_Slot(ProxyConnection_P connection, ProxySlot_P slot, long long now){
+  char *output = NULL;
+  int capacity = connection->outputCapacity;
+  if(connection->outputLength + slot->requestLength > capacity)
+  {
+	while(connection->outputLength + slot->requestLength > capacity) capacity = capacity ? capacity * 2 : PROXY_BUFFER_SIZE;
+	output = (char *) realloc(connection->output, capacity);
+	if(output == NULL) return -1;
+	connection->output = output;
+	connection->outputCapacity = capacity;
+  }
+  memcpy(connection->output + connection->outputLength, slot->request, slot->requestLength);
+  connection->outputLength += slot->requestLength;
+  slot->sentAt = now;
+  slot->nextSent = NULL;
+  if(connection->sentTail != NULL) connection->sentTail->nextSent = slot;
+  else connection->sentHead = slot;
+  connection->sentTail = slot;
+  return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void write_Connection(ProxyConnection_P connection){
+  int byteSentCount = 0;
+  if(!connection->connected) return;
+  while(connection->outputSent < connection->outputLength)
+  {
+	byteSentCount = send(connection->fd, connection->output + connection->outputSent, connection->outputLength - connection->outputSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if(byteSentCount == -1)
+	{
+		if(errno == EINTR) continue;
+		if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+		fail_Connection(connection);
+		return;
+	}
+	connection->outputSent += byteSentCount;
+  }
+  if(connection->outputSent == connection->outputLength) connection->outputSent = connection->outputLength = 0;
+  watch_Connection(connection, (connection->outputLength > 0) ? EPOLLIN | EPOLLOUT : EPOLLIN);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void read_Connection(ProxyConnection_P connection){
+  ProxySlot_P slot = NULL;
+  char *input = NULL;
+  int byteReceivedCount = 0, length = 0, offset = 0;
+  while(1)
+  {
+	if(connection->inputCapacity - connection->inputLength < PROXY_BUFFER_SIZE)
+	{
+		input = (char *) realloc(connection->input, connection->inputCapacity ? connection->inputCapacity * 2 : PROXY_BUFFER_SIZE * 2);
+		if(input == NULL)
+		{
+			fail_Connection(connection);
+			return;
+		}
+		connection->input = input;
+		connection->inputCapacity = connection->inputCapacity ? connection->inputCapacity * 2 : PROXY_BUFFER_SIZE * 2;
+	}
+	byteReceivedCount = recv(connection->fd, connection->input + connection->inputLength, connection->inputCapacity - connection->inputLength, MSG_DONTWAIT);
+	if(byteReceivedCount == -1 && errno == EINTR) continue;
+	if(byteReceivedCount == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+	if(byteReceivedCount <= 0)
+	{
+		fail_Connection(connection);
+		return;
+	}
+	connection->inputLength += byteReceivedCount;
+	connection->lastActivity = proxy_Clock();
+
+	//replies come back in the order their requests were sent
+	for(offset = 0; (length = responseLength(connection->input + offset, connection->inputLength - offset)) > 0; offset += length)
+	{
+		slot = connection->sentHead;
+		if(slot == NULL)
+		{
+			fail_Connection(connection);
+			return;
+		}
+		connection->sentHead = slot->nextSent;
+		if(connection->sentHead == NULL) connection->sentTail = NULL;
+		slot->nextSent = NULL;
+		if(slot == &connection->probe) continue;
+		//the reply is handed over where it lies in the input, so it is copied only by a client that keeps it
+		slot->done = 1;
+		connection->pool->deliver(slot, connection->input + offset, length);
+	}
+	connection->inputLength -= offset;
+	memmove(connection->input, connection->input + offset, connection->inputLength);
+  }
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void watch_Connection(ProxyConnection_P connection, uint32_t events){
+  struct epoll_event event;
+  if(connection->events == events) return;
+  event.events = events;
+  event.data.ptr = connection;
+  epoll_ctl(connection->pool->epollfd, EPOLL_CTL_MOD, connection->fd, &event);
+  connection->events = events;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+long long proxy_Clock(void){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
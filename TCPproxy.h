@@ -0,0 +1,136 @@
+/**	@file TCPproxy.h
+ * 	@brief Contains the function prototypes for running the server as a proxy in front of
+ *	other server instances, implemented in TCPproxy.c
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+/*
+ * TCPproxy.h
+ *
+ * In proxy mode the server answers no requests itself except <stats/>; it forwards them to
+ * a list of backend servers, so clients only need to know the proxy. Requests are placed on
+ * a consistent hash ring of the backends with PROXY_VIRTUAL_NODES points each, so the same
+ * request always goes to the same backend and adding or removing a backend only moves the
+ * requests of its neighbours on the ring. <loadavg/> requests carry no state and go to the
+ * backends round robin.
+ *
+ * Every worker thread keeps one connection to every backend and pipelines the requests of
+ * all its clients on it; the requests of a round go out in one write per backend. Replies
+ * come back in the order their requests were sent and are put back in the order of each
+ * client's own requests.
+ *
+ * Backends are checked with a <loadavg/> probe when their connection has been idle for
+ * PROXY_PROBE_MS. A backend that refuses the connection, closes it or leaves a request
+ * unanswered for PROXY_TIMEOUT_MS is marked down for every worker for PROXY_RETRY_MS; its
+ * requests are sent again to the next backend on the ring, at most PROXY_MAX_RETRIES times.
+ */
+
+#include <stdint.h>
+
+/*
+ **************************************************
+ *		COMPILER PRE DEFINES
+ **************************************************
+ */
+
+#define PROXY_MAX_BACKENDS 64
+#define PROXY_VIRTUAL_NODES 160
+#define PROXY_MAX_REQUEST 256
+#define PROXY_BUFFER_SIZE 4096
+#define PROXY_CHECK_MS 100
+#define PROXY_PROBE_MS 1000
+#define PROXY_TIMEOUT_MS 2000
+#define PROXY_RETRY_MS 1000
+#define PROXY_MAX_RETRIES 2
+#define EVENT_BACKEND 3
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	A forwarded request and, if it comes back before those of the owner's earlier requests, its reply
+ */
+typedef struct ProxySlot{
+  void *owner;	//the client waiting for the reply, NULL once it has gone
+  char request[PROXY_MAX_REQUEST + 1];
+  int requestLength;
+  uint32_t hash;	//where the request sits on the ring
+  int roundRobin;	//non zero for requests that may go to any backend
+  int retries;
+  long long sentAt;
+  char *reply;	//a reply the owner keeps until those before it are in, allocated with malloc
+  int replyLength;
+  int done;	//set once the reply has come
+  struct ProxySlot *next;	//the owner's next request
+  struct ProxySlot *nextSent;	//the next request on the same backend connection
+}ProxySlot_T, *ProxySlot_P;
+
+/*
+ *	Called on the worker thread when a slot is done; the slot belongs to the callee again.
+ *	The reply is only valid during the call, so a callee that keeps it copies it.
+ */
+typedef void (*ProxyDeliver)(ProxySlot_P slot, char *reply, int length);
+
+typedef struct ProxyPool ProxyPool_T, *ProxyPool_P;
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Reads the list of backends and builds the hash ring. Must be called before any
+*			worker starts.
+*	@param 	*backends is a comma separated list of host:port pairs or local socket paths,
+*			either starting with '/' or after "unix:".
+*	@return returns the number of backends, or -1 if the list cannot be used.
+*/
+int configure_Proxy(char *backends);
+
+/**	@brief 	Creates the backend connections of one worker thread and starts connecting them.
+*	@param 	epollfd is the worker's epoll descriptor; connection events carry a pointer to
+*			a structure starting with EVENT_BACKEND.
+*			deliver is called for every slot that is done.
+*	@return returns the pool, or NULL if proxy mode is off or there is not enough memory.
+*/
+ProxyPool_P create_Proxy_Pool(int epollfd, ProxyDeliver deliver);
+
+/**	@brief 	Queues a request for its backend. It is written by the next proxy_Flush.
+*	@param 	pool is the worker's pool.
+*			slot is filled in with the request and must stay allocated until it is delivered.
+*			*request is the request and length its number of bytes, at most PROXY_MAX_REQUEST.
+*	@return returns nothing; if no backend is up the slot is delivered with an error reply.
+*/
+void proxy_Forward(ProxyPool_P pool, ProxySlot_P slot, char *request, int length);
+
+/**	@brief 	Handles an epoll event of a backend connection.
+*	@param 	pool is the worker's pool.
+*			*connection is the event's data pointer.
+*			events are the epoll events.
+*	@return returns nothing.
+*/
+void proxy_Event(ProxyPool_P pool, void *connection, uint32_t events);
+
+/**	@brief 	Writes the requests queued on every backend connection.
+*	@param 	pool is the worker's pool.
+*	@return returns nothing.
+*/
+void proxy_Flush(ProxyPool_P pool);
+
+/**	@brief 	Probes idle backends, fails those that stopped answering and reconnects
+*			those whose time to retry has come.
+*	@param 	pool is the worker's pool.
+*	@return returns the milliseconds until the next check.
+*/
+int proxy_Check(ProxyPool_P pool);
+
+/**	@brief 	Writes the proxy's counters for the <stats/> reply.
+*	@param 	*buffer is filled in with the counters.
+*	@return returns nothing.
+*/
+void proxy_Stats(char *buffer);
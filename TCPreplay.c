@@ -0,0 +1,382 @@
+/**	@file TCPreplay.c
+ * 	@brief Contains the main program for replaying a capture file recorded by the TCP server.
+ *	Every connection in the capture is replayed on its own client socket and thread using the
+ *	C client API, at the recorded pace, at a multiple of it or as fast as possible.
+ *	Prints the number of requests, the throughput and the latency percentiles when it is done.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include "TCPclient.h"
+#include "TCPcapture.h"
+
+/*
+ **************************************************
+ *		COMPILER PRE DEFINES
+ **************************************************
+ */
+
+#define NANOSECONDS 1000000000ULL
+#define NANOSECONDS_PER_MS 1000000ULL
+#define MICROSECOND 1000.0
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	The requests of one captured connection and the results of replaying them
+ */
+typedef struct ReplayConnection{
+  int sockfd;
+  struct sockaddr_in servDest;
+  CaptureRecord_P records;	//the requests of this connection in the order they were sent
+  int count;
+  double speed;	//multiple of the recorded pace, 0 for as fast as possible
+  struct timespec start;
+  uint64_t *latencies;	//nanoseconds per answered request; until then when the request was due
+  int completed;
+  int failed;
+  char *received;	//bytes received that are not a whole response yet
+  long receivedLength;
+  long receivedCapacity;
+}ReplayConnection_T, *ReplayConnection_P;
+
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Replays the requests of one connection and records the latency of every reply.
+*			Every request is sent at its recorded time, whether or not the replies to the
+*			ones before it are in, and the replies are matched to the requests in order.
+*	@param 	is a void pointer to the ReplayConnection structure of the connection.
+*	@return returns a void pointer.
+*/
+void *replayConnection( void * param );
+
+/**	@brief 	Reads whatever the server has sent on a connection without waiting. The replies
+*			are framed afterwards with responseLength the way the clients frame them, so a
+*			reply split over several receives or larger than MAX_MESSAGE is still paired
+*			with its own request.
+*	@param 	replay is the connection.
+*	@return returns 0 once nothing more is waiting, -1 if the connection failed or was closed;
+*			what was received before is kept either way.
+*/
+int receiveReplayResponses(ReplayConnection_P replay);
+
+/**	@brief 	Orders capture records by connection and then by time so each connection's
+*			requests are next to each other.
+*	@param 	*first and *second are the two CaptureRecord structures to compare.
+*	@return returns a negative number, zero or a positive number like strcmp.
+*/
+int compareRecords(const void *first, const void *second);
+
+/**	@brief 	Orders two latencies for qsort.
+*	@param 	*first and *second are the two latencies to compare.
+*	@return returns a negative number, zero or a positive number like strcmp.
+*/
+int compareLatencies(const void *first, const void *second);
+
+/**	@brief 	Returns the number of nanoseconds between two times.
+*	@param 	*from is the earlier time and *to the later one.
+*	@return returns the difference in nanoseconds.
+*/
+uint64_t elapsed(struct timespec *from, struct timespec *to);
+
+/**	@brief 	Prints the throughput and latency percentiles of the replay.
+*	@param 	*latencies are the sorted latencies of every answered request.
+*			count is the number of latencies.
+*			failed is the number of requests that got no reply.
+*			connections is the number of connections replayed.
+*			seconds is how long the replay took.
+*	@return returns nothing.
+*/
+void printReport(uint64_t *latencies, int count, int failed, int connections, double seconds);
+
+
+/**	@brief 	The main program for replaying a capture file against a server.
+*	@param 	argv[1] is the server's IP address or host name, argv[2] its port number,
+*			argv[3] the capture file and the optional argv[4] the replay speed:
+*			1 for the recorded pace (the default), N for N times faster and 0 for as fast as possible.
+*	@return returns 0 to the OS when the replay completes, 1 if it could not run.
+*/
+int main(int argc, char**argv)
+{
+	FILE *captureFile;
+	CaptureRecord_P records = NULL;
+	ReplayConnection_P connections = NULL;
+	pthread_t *threads = NULL;
+	uint64_t *latencies = NULL;
+	int count = 0, capacity = 0, connectionCount = 0, latencyCount = 0, failed = 0, result = 0, i = 0, j = 0;
+	uint64_t first = 0;
+	double speed = 1.0;
+	struct timespec start, end;
+
+	if(argc != 4 && argc != 5)
+	{
+		printf("Incorrect Number of Command Line Arguments\n");
+		printf("./replay <IP Address or Server Host Name> <Port Number> <Capture File> [Speed, 0 for as fast as possible]\n");
+		return 1;
+	}
+	if(argc == 5) speed = atof(argv[4]);
+	if(speed < 0.0)
+	{
+		fprintf(stderr, "ERROR: Replay Speed Cannot Be Negative\n");
+		return 1;
+	}
+
+	//read every request in the capture
+	captureFile = open_Capture_Reader(argv[3]);
+	if(captureFile == NULL)
+	{
+		fprintf(stderr, "ERROR: %s Is Not a Capture File\n", argv[3]);
+		return 1;
+	}
+	while(1)
+	{
+		if(count == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 1024;
+			records = (CaptureRecord_P) realloc(records, capacity * sizeof(CaptureRecord_T));
+			if(records == NULL)
+			{
+				fprintf(stderr, "ERROR: Capture File Is Too Large\n");
+				return 1;
+			}
+		}
+		result = read_Capture_Record(captureFile, &records[count]);
+		if(result != 1) break;
+		count++;
+	}
+	fclose(captureFile);
+	if(result == -1)
+		fprintf(stderr, "ERROR: Capture File Is Damaged, Replaying the First %d Requests\n", count);
+	if(count == 0)
+	{
+		printf("Capture File Has No Requests\n");
+		return 0;
+	}
+
+	//the replay starts with the first recorded request, not when the capture was opened
+	for(i = 1, j = 0; i < count; i++)
+		if(records[i].timestamp < records[j].timestamp) j = i;
+	for(i = 0, first = records[j].timestamp; i < count; i++)
+		records[i].timestamp -= first;
+
+	//split the requests into their connections
+	qsort(records, count, sizeof(CaptureRecord_T), compareRecords);
+	for(i = 0; i < count; i++)
+		if(i == 0 || records[i].connection != records[i - 1].connection) connectionCount++;
+	connections = (ReplayConnection_P) calloc(connectionCount, sizeof(ReplayConnection_T));
+	threads = (pthread_t *) calloc(connectionCount, sizeof(pthread_t));
+	latencies = (uint64_t *) malloc(count * sizeof(uint64_t));
+	if(connections == NULL || threads == NULL || latencies == NULL)
+	{
+		fprintf(stderr, "ERROR: Capture File Is Too Large\n");
+		return 1;
+	}
+	for(i = 0, j = -1; i < count; i++)
+	{
+		if(i == 0 || records[i].connection != records[i - 1].connection)
+		{
+			connections[++j].records = &records[i];
+			connections[j].latencies = &latencies[i];
+			connections[j].speed = speed;
+		}
+		connections[j].count++;
+	}
+
+	//connect everything before the clock starts so connection setup is not measured
+	for(i = 0; i < connectionCount; i++)
+	{
+		connections[i].sockfd = createSocket(argv[1], atoi(argv[2]), &connections[i].servDest);
+		if(connections[i].sockfd < 0)
+		{
+			fprintf(stderr, "ERROR: Cannot Open Connection %d of %d\n", i + 1, connectionCount);
+			return 1;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < connectionCount; i++)
+	{
+		connections[i].start = start;
+		if(pthread_create(&threads[i], NULL, replayConnection, (void *) &connections[i]) != 0)
+		{
+			fprintf(stderr, "ERROR: Cannot Start Replay Thread\n");
+			return 1;
+		}
+	}
+	for(i = 0; i < connectionCount; i++)
+	{
+		pthread_join(threads[i], NULL);
+		closeSocket(connections[i].sockfd);
+		free(connections[i].received);
+		//gather the latencies of all connections at the front of the array
+		memmove(&latencies[latencyCount], connections[i].latencies, connections[i].completed * sizeof(uint64_t));
+		latencyCount += connections[i].completed;
+		failed += connections[i].failed;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	qsort(latencies, latencyCount, sizeof(uint64_t), compareLatencies);
+	printReport(latencies, latencyCount, failed, connectionCount, elapsed(&start, &end) / (double) NANOSECONDS);
+
+	for(i = 0; i < count; i++) free(records[i].request);
+	free(records);
+	free(connections);
+	free(threads);
+	free(latencies);
+	return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void *replayConnection( void * param ){
+  ReplayConnection_P replay = (ReplayConnection_P) param;
+  struct pollfd socket;
+  struct timespec now;
+  uint64_t due = 0, current = 0;
+  long byteSentCount = 0, sentLength = 0;
+  int next = 0, timeout = 0, length = 0, closed = 0;
+
+  //the socket never blocks, so a reply the server is slow with holds up neither the requests
+  //due after it nor the reading of the replies to them
+  fcntl(replay->sockfd, F_SETFL, fcntl(replay->sockfd, F_GETFL) | O_NONBLOCK);
+  socket.fd = replay->sockfd;
+  while(replay->completed < replay->count)
+  {
+	//the next request is due at its recorded time, or at once when replaying as fast as possible
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	current = elapsed(&replay->start, &now);
+	timeout = -1;
+	if(next < replay->count)
+	{
+		due = (replay->speed > 0.0) ? (uint64_t) (replay->records[next].timestamp / replay->speed) : 0;
+		if(due > current) timeout = (int) ((due - current + NANOSECONDS_PER_MS - 1) / NANOSECONDS_PER_MS);
+		else if(sentLength == 0) replay->latencies[next] = (replay->speed > 0.0) ? due : current;
+	}
+	socket.events = POLLIN | ((next < replay->count && timeout == -1) ? POLLOUT : 0);
+	if(poll(&socket, 1, timeout) == -1)
+	{
+		if(errno == EINTR) continue;
+		break;
+	}
+
+	if(socket.revents & POLLOUT)
+	{
+		byteSentCount = send(replay->sockfd, replay->records[next].request + sentLength, replay->records[next].length - sentLength, MSG_NOSIGNAL);
+		if(byteSentCount == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) break;
+		if(byteSentCount > 0) sentLength += byteSentCount;
+		if(sentLength == replay->records[next].length)
+		{
+			next++;
+			sentLength = 0;
+		}
+	}
+	if(socket.revents & (POLLIN | POLLHUP | POLLERR))
+	{
+		closed = (receiveReplayResponses(replay) == -1);
+		//the replies come in the order of the requests; latency counts from when the request was due
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		current = elapsed(&replay->start, &now);
+		while(replay->completed < next && (length = responseLength(replay->received, replay->receivedLength)) > 0)
+		{
+			replay->latencies[replay->completed] = current - replay->latencies[replay->completed];
+			replay->completed++;
+			replay->receivedLength -= length;
+			memmove(replay->received, replay->received + length, replay->receivedLength);
+		}
+		//a reply to a request that was not sent yet means the replies no longer line up
+		if(closed || (replay->completed == next && responseLength(replay->received, replay->receivedLength) > 0)) break;
+	}
+  }
+  replay->failed = replay->count - replay->completed;
+  return NULL;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int receiveReplayResponses(ReplayConnection_P replay){
+  char *grown = NULL;
+  long byteReceivedCount = 0;
+  while(1)
+  {
+	if(replay->receivedLength == replay->receivedCapacity)
+	{
+		grown = (char *) realloc(replay->received, replay->receivedCapacity ? replay->receivedCapacity * 2 : MAX_MESSAGE);
+		if(grown == NULL) return -1;
+		replay->received = grown;
+		replay->receivedCapacity = replay->receivedCapacity ? replay->receivedCapacity * 2 : MAX_MESSAGE;
+	}
+	byteReceivedCount = recv(replay->sockfd, replay->received + replay->receivedLength, replay->receivedCapacity - replay->receivedLength, 0);
+	if(byteReceivedCount == -1 && errno == EINTR) continue;
+	if(byteReceivedCount == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+	if(byteReceivedCount <= 0) return -1;
+	replay->receivedLength += byteReceivedCount;
+  }
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int compareRecords(const void *first, const void *second){
+  CaptureRecord_P a = (CaptureRecord_P) first, b = (CaptureRecord_P) second;
+  if(a->connection != b->connection) return (a->connection < b->connection) ? -1 : 1;
+  if(a->timestamp != b->timestamp) return (a->timestamp < b->timestamp) ? -1 : 1;
+  return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int compareLatencies(const void *first, const void *second){
+  uint64_t a = *(uint64_t *) first, b = *(uint64_t *) second;
+  return (a > b) - (a < b);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+uint64_t elapsed(struct timespec *from, struct timespec *to){
+  return (uint64_t) (to->tv_sec - from->tv_sec) * NANOSECONDS + to->tv_nsec - from->tv_nsec;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void printReport(uint64_t *latencies, int count, int failed, int connections, double seconds){
+  printf("Replayed %d requests on %d connections in %.3f s (%.0f requests/s), %d failed\n", count, connections, seconds, seconds > 0.0 ? count / seconds : 0.0, failed);
+  if(count == 0) return;
+  printf("Latency (us) : min %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+	latencies[0] / MICROSECOND,
+	latencies[(int) (count * 0.50)] / MICROSECOND,
+	latencies[(int) (count * 0.90)] / MICROSECOND,
+	latencies[(int) (count * 0.99)] / MICROSECOND,
+	latencies[(int) (count * 0.999)] / MICROSECOND,
+	latencies[count - 1] / MICROSECOND);
+}
@@ -0,0 +1,83 @@
+/**	@file TCPresponse.c
+ * 	@brief Contains the function implementation for framing the replies of the TCP server,
+ *	shared by the clients and by the server's proxy mode.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "TCPresponse.h"
+
+
+/*
+ * Finds the end of the first whole response in the bytes received from the server.
+ * Echoed text comes back escaped, so it cannot hold a closing tag.
+ *
+ * buffer - the bytes received from the server
+ * length - the number of bytes in buffer
+ *
+ * return - the length of the first response, or 0 if no response is complete yet
+ */
+int responseLength(char * buffer, int length){
+	static const char * endTags[] = { "</reply>", "</replyLoadAvg>", "</replyStats>", "</error>" };
+	int i = 0, tag = 0, tagLength = 0, startLength = strlen(FILE_REPLY_START);
+	long fileLength = 0;
+	char * end = NULL;
+
+	//a file reply says how long it is, since the file itself may contain closing tags
+	if(length >= startLength && !memcmp(buffer, FILE_REPLY_START, startLength))
+	{
+		end = memchr(buffer + startLength, '>', length - startLength);
+		if(end == NULL) return 0;
+		fileLength = strtol(buffer + startLength, NULL, 10);
+		fileLength += (end + 1 - buffer) + strlen(FILE_REPLY_END);
+		if(fileLength > INT_MAX || fileLength > length) return 0;
+		return (int) fileLength;
+	}
+	for(i = 0; i + 1 < length; i++)
+	{
+		if(buffer[i] != '<' || buffer[i + 1] != '/') continue;
+		for(tag = 0; tag < sizeof(endTags) / sizeof(endTags[0]); tag++)
+		{
+			tagLength = strlen(endTags[tag]);
+			if(i + tagLength <= length && !memcmp(buffer + i, endTags[tag], tagLength))
+				return i + tagLength;
+		}
+	}
+	return 0;
+}
+
+
+/*
+ * Turns the escaped text of a <reply> back into the text that was echoed, in place. Other
+ * responses are left as they are.
+ *
+ * response - the first whole response received from the server
+ * length   - the length of the response, as found by responseLength
+ *
+ * return - the length of the response once unescaped
+ */
+int unescapeResponse(char * response, int length){
+	int from = strlen(ECHO_REPLY_START), to = from;
+	if(length < from || memcmp(response, ECHO_REPLY_START, from)) return length;
+	while(from < length)
+	{
+		//the server escapes nothing but '<' and '&'
+		if(from + 4 <= length && !memcmp(response + from, "&lt;", 4))
+		{
+			response[to++] = '<';
+			from += 4;
+		}
+		else if(from + 5 <= length && !memcmp(response + from, "&amp;", 5))
+		{
+			response[to++] = '&';
+			from += 5;
+		}
+		else
+			response[to++] = response[from++];
+	}
+	return to;
+}
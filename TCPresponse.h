@@ -0,0 +1,55 @@
+/**	@file TCPresponse.h
+ * 	@brief Contains the function prototype for framing the replies of the TCP server, shared by
+ *	the clients and by the server's proxy mode and implemented in TCPresponse.c
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+/*
+ * TCPresponse.h
+ *
+ * Replies carry no length of their own. Every reply ends with the closing tag of its reply or
+ * error element, and the server escapes echoed text, '<' as "&lt;" and '&' as "&amp;", so the
+ * first closing tag found is always the reply's own. The clients turn the text of a <reply>
+ * back into what was sent with unescapeResponse before handing it on, so only the bytes on
+ * the wire are escaped. Only file replies, whose file may contain anything, give their
+ * length: <replyFile length="N">, the N bytes of the file and </replyFile>.
+ */
+
+/*
+ **************************************************
+ *		COMPILER PRE DEFINES
+ **************************************************
+ */
+
+#define FILE_REPLY_START "<replyFile length=\""
+#define FILE_REPLY_END "</replyFile>"
+#define ECHO_REPLY_START "<reply>"
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/*
+ * Finds the end of the first whole response in the bytes received from the server.
+ *
+ * buffer - the bytes received from the server
+ * length - the number of bytes in buffer
+ *
+ * return - the length of the first response, or 0 if no response is complete yet
+ */
+int responseLength(char * buffer, int length);
+
+/*
+ * Turns the escaped text of a <reply> back into the text that was echoed, in place. Other
+ * responses are left as they are.
+ *
+ * response - the first whole response received from the server
+ * length   - the length of the response, as found by responseLength
+ *
+ * return - the length of the response once unescaped
+ */
+int unescapeResponse(char * response, int length);
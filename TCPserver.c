@@ -7,8 +7,18 @@
  *	Messages can be sent to the server in the following format:
  *	<echo>message</echo>
  *	<loadavg/>
+ *	<stats/>
+ *	<get-file>name</get-file>
  *	If a message is sent that is not in the above format, 
  *	server responses with <error>unknown format</error>.
+ *	Clients are served by a pool of worker threads. Each worker waits for its clients with epoll
+ *	and serves the ready ones round robin, a limited number of requests each per round, so one busy
+ *	client cannot hold up the others. The requests of each client address can also be rate limited.
+ *	Clients on the same host can also connect through an optional Unix domain socket.
+ *	As a proxy it forwards the requests to other server instances instead (see TCPproxy.h).
+ *	Requests can optionally be recorded to a capture file for replay (see TCPcapture.h).
+ *	The text of an <echo> comes back with '<' and '&' escaped, so no reply holds a closing
+ *	tag before its own and pipelined replies cannot be split in the wrong place.
  * 	@author Cole Amick
  * 	@author Daniel Davis
  * 	@bug No known bugs!
@@ -26,12 +36,81 @@
  *	Used to store connected client information
  */
 typedef struct ClientStruct{
+  int kind;	//always EVENT_CLIENT, so an epoll event can tell a client from a task, a backend or the stop event
   int confd;
-  char message[MAX_MESSAGE];
-  struct sockaddr_in clientaddr;
+  char message[MAX_MESSAGE];	//bytes received from the client that are not yet a complete request
+  int messageLength;
+  uint32_t connection;	//id of the connection in capture files
+  struct sockaddr_storage clientaddr;	//sockaddr_in for TCP clients, sockaddr_un for local ones
+  uint64_t rateKey;	//token bucket of the client's address
+  struct Worker *worker;	//the worker thread that serves this client
+  uint32_t events;	//epoll events currently watched
+  int ready;	//non zero while on the worker's ready list
+  int timed;	//non zero while on the worker's timed list
+  int throttled;	//non zero while waiting for the rate limit
+  long long deadline;	//when the rate limit wait or the wait for the rest of a request ends, 0 for none
+  int waitOver;	//non zero once the wait for the rest of a request has ended
+  int pipelining;	//non zero once the client has sent a request before its last one was read
+  int discarding;	//DISCARD_LINE or DISCARD_ECHO while the rest of a request too long is dropped
+  int draining;	//non zero once the client has stopped sending; it is closed when it has every reply
+  struct ClientStruct *nextReady;
+  struct ClientStruct *nextTimed;
+  char *output;	//replies that are not sent yet
+  int outputLength;
+  int outputSent;
+  int outputCapacity;
+  int stream;	//non zero unless the client is on a SOCK_SEQPACKET socket
+  Task_P task;	//a handler that is waiting, NULL for none; no request is read until it is done
+  ProxySlot_P slotHead;	//forwarded requests in the order their replies are due, in proxy mode
+  ProxySlot_P slotTail;
+  int slotCount;
 }ClientStruct_T, *ClientStruct_P;
 
 
+/*
+ *	The frame of a task sending a file
+ */
+typedef struct FileSend{
+  FileEntry_P file;
+  off_t sent;
+}FileSend_T, *FileSend_P;
+
+
+/*
+ *	A worker thread and the clients it serves
+ */
+typedef struct Worker{
+  int epollfd;
+  pthread_t tid;
+  int budget;	//requests served per client in each round
+  ClientStruct_P readyHead;	//clients with work to do, served round robin
+  ClientStruct_P readyTail;
+  int readyCount;
+  ClientStruct_P timed;	//clients waiting for a deadline
+  ProxyPool_P proxy;	//connections to the backends in proxy mode, NULL otherwise
+}Worker_T, *Worker_P;
+
+
+/*
+ *	Counters reported by the <stats/> command
+ */
+typedef struct ServerStats{
+  unsigned long connections;
+  unsigned long active;
+  unsigned long requests;
+  unsigned long budgetYields;	//rounds in which a client used its whole budget and had to make way
+  unsigned long rateLimited;	//times a client had to wait for its rate limit
+}ServerStats_T, *ServerStats_P;
+
+static ServerStats_T stats;
+static int proxying = 0;	//non zero if requests are forwarded to backends
+static int quiet = 0;	//non zero if requests and replies are not printed
+static int sendTimeout = DEFAULT_SEND_TIMEOUT_MS;	//how long a file waits for a client that takes none of it
+static volatile sig_atomic_t stopping = 0;	//set by stop_Server
+static int stopfd = -1;	//becomes readable in every worker's epoll once the server stops
+static int stopKind = EVENT_STOP;	//the epoll data of stopfd
+
+
 /*
  **************************************************
  *		FUNCTION PROTOTYPES
@@ -46,64 +125,203 @@ typedef struct ClientStruct{
 void printErrorMessage( char *message );
 
  
-/**	@brief 	Is the function for create detached threads to handle the message sent from the client. 
-*	@param 	is a void pointer to the client data structure and is typed cast internally back
+/**	@brief 	Is the function run by each worker thread. Waits for its clients with epoll and
+*			serves the ready ones round robin, each up to its budget per round, until
+*			the server stops. 
+*	@param 	is a void pointer to the Worker structure and is typed cast internally back
 *			to the correct structure type. 
 *	@return returns a void pointer. 
 */
-void *receiveMessage( void * param );
+void *run_Worker( void * param );
 
 
-/**	@brief 	Modifies the sent message and return the modified message to the client. 
-*	@param 	clientaddr is a structure containing the connected client identification and the
-*			message that was sent to the server to be processed. 
-*			recvMesg is a char array containing the client message that was sent to the server. 
+/**	@brief 	Serves one client for one round: reads what it has sent and handles up to the
+*			worker's budget of requests, then sends the replies together. 
+*	@param 	worker is the worker serving the client.
+*			clientStruct_p is the client. 
+*	@return returns CLIENT_BUSY if the budget ran out with work left, CLIENT_IDLE if the client
+*			has to wait for the socket, a deadline or the rate limit and CLIENT_CLOSED if it is gone. 
+*/
+int serve_Client(Worker_P worker, ClientStruct_P clientStruct_p);
+
+
+/**	@brief 	Resumes the client's waiting handler, if it has one, and sets up what the handler
+*			waits for next: the client's socket, another descriptor or a timer. 
+*	@param 	worker is the worker serving the client.
+*			clientStruct_p is the client. 
+*	@return returns CLIENT_READY if the client has no handler left waiting, CLIENT_IDLE if it
+*			is waiting, CLIENT_BUSY if it gave way to the other clients and CLIENT_CLOSED if the
+*			client has to be disconnected. 
+*/
+int run_Client_Task(Worker_P worker, ClientStruct_P clientStruct_p);
+
+
+/**	@brief 	Handles the first request in the client's buffer and removes it from the buffer. 
+*	@param 	clientStruct_p is the client. 
+*			requestLength is the length of the request. 
 *	@return returns nothing. 
 */
-void handleMessage(ClientStruct_P clientaddr, char *recvMesg);
+void handle_Request(ClientStruct_P clientStruct_p, int requestLength);
+
+
+/**	@brief 	Answers a request too long for the client's buffer with a single error. The rest of
+*			the request is dropped as it arrives, up to the newline or </echo> that ends it. 
+*	@param 	clientStruct_p is the client, whose buffer holds the start of the request. 
+*	@return returns nothing. 
+*/
+void refuse_Request(ClientStruct_P clientStruct_p);
+
+
+/**	@brief 	Drops what the client sent of a request that was refused, up to and including its end. 
+*	@param 	clientStruct_p is the client. 
+*	@return returns nothing. 
+*/
+void discard_Request(ClientStruct_P clientStruct_p);
+
+
+/**	@brief 	Queues a reply made by the server itself behind the replies still due from the
+*			backends, so that the client gets its replies in the order of its requests. 
+*	@param 	clientStruct_p is the client. 
+*			*reply is the reply and length its number of bytes. 
+*	@return returns nothing. 
+*/
+void queue_Reply(ClientStruct_P clientStruct_p, char *reply, int length);
 
 
-/**	@brief 	Determines if the message is a valid ECHO or LOADAVG command or
-*			if the message is a error message, and makes decisions based upon this.
-*	@param 	*recvMesg is a char array containing the client message that was sent to the server.
-*			*send is the char array representing the message to be sent back to the client. 
+/**	@brief 	Forwards a request to its backend in proxy mode. <stats/> is answered by the
+*			proxy itself, in its turn among the client's forwarded requests, and so is a
+*			<get-file> from a seqpacket client, which cannot take a file. 
+*	@param 	clientStruct_p is the client. 
+*			*request is the request and requestLength its number of bytes. 
 *	@return returns nothing. 
 */
-void modifyMessage(char *recvMesg, char *send);
+void proxy_Request(ClientStruct_P clientStruct_p, char *request, int requestLength);
 
 
-/**	@brief 	The client sent a message in the ECHO header and should be returned to the client
-*			in REPLY headers. 
-*	@param 	*recvMesg is a char array containing the client message that was sent to the server. 
-*			*send is the char array representing the message to be sent back to the client. 
+/**	@brief 	Takes the reply of a forwarded request. The reply due next goes straight to the
+*			client's output, with the replies that came before it, and the client is
+*			scheduled to send them; a reply that comes early is kept in its slot. 
+*	@param 	slot is the forwarded request; the slot of a client that has gone is freed. 
+*			*reply is the reply and length its number of bytes, valid only during the call. 
 *	@return returns nothing. 
 */
-void echoMessage(char *recvMesg, char *send);
+void deliver_Proxy_Reply(ProxySlot_P slot, char *reply, int length);
 
 
-/**	@brief 	The client sent the <loadavg/> message and therefore the load average
-*			on the server for 1:5:15 minutes.
-*	@param 	*recvMesg is a char array containing the keyword -> <loadavg/>
-*			*send is a char array containing the load average calculations. 
+/**	@brief 	Puts a client on the worker's ready list unless it is already there or throttled. 
+*	@param 	worker is the worker serving the client.
+*			clientStruct_p is the client. 
 *	@return returns nothing. 
 */
-void loadavgMessage(char *recvMesg, char *send);
+void schedule_Client(Worker_P worker, ClientStruct_P clientStruct_p);
 
 
-/**	@brief	The client sent the server a invalid message and must be returned
-*			to the client as a invalid input. 
-*	@param 	*recvMesg is a char array contains the message that the client sent to the server.
-*			*send is the char array representing the message to be sent back to the client. 
-*	@return	returns nothing. 
+/**	@brief 	Sets a client's deadline and puts it on the worker's timed list. 
+*	@param 	worker is the worker serving the client.
+*			clientStruct_p is the client. 
+*			deadline is the monotonic time in milliseconds when the client's wait ends. 
+*	@return returns nothing. 
 */
-void errorMessage(char *recvMesg, char *send);
+void set_Deadline(Worker_P worker, ClientStruct_P clientStruct_p, long long deadline);
 
 
-/**	@brief	Used to reverse a string pass into the function. 
-*	@param	*original is the string to reverse, it directly modifies this char array 
-*	@return	returns nothing. 
+/**	@brief 	Wakes the clients whose deadline has passed and works out how long the worker
+*			may sleep until the next one. 
+*	@param 	worker is the worker. 
+*	@return returns the milliseconds until the next deadline, or -1 if there is none. 
 */
-void reverseString(char *original);
+int expire_Deadlines(Worker_P worker);
+
+
+/**	@brief 	Changes the epoll events watched for a client. 
+*	@param 	clientStruct_p is the client. 
+*			events are the epoll events to watch, 0 for none. 
+*	@return returns nothing. 
+*/
+void watch_Client(ClientStruct_P clientStruct_p, uint32_t events);
+
+
+/**	@brief 	Appends a reply to the client's output. On a seqpacket connection the reply is
+*			stored after its length, so that it still goes out as a packet of its own. 
+*	@param 	clientStruct_p is the client. 
+*			*reply is the reply and length its number of bytes. 
+*	@return returns 0, or -1 if there is not enough memory. 
+*/
+int append_Output(ClientStruct_P clientStruct_p, char *reply, int length);
+
+
+/**	@brief 	Sends as much of the client's output as the socket takes without waiting. Stream
+*			clients get their replies in as few sends as possible, seqpacket clients one
+*			packet per reply. A file that follows is sent by its own task. 
+*	@param 	clientStruct_p is the client. 
+*	@return returns 0, or -1 if the connection failed. 
+*/
+int flush_Output(ClientStruct_P clientStruct_p);
+
+
+/**	@brief 	Tells whether a client has replies that are not sent yet. 
+*	@param 	clientStruct_p is the client. 
+*	@return returns non zero if output is waiting to be sent. 
+*/
+int output_Pending(ClientStruct_P clientStruct_p);
+
+
+/**	@brief 	Closes a client's connection and frees it. 
+*	@param 	worker is the worker serving the client.
+*			clientStruct_p is the client. 
+*	@return returns nothing. 
+*/
+void close_Client(Worker_P worker, ClientStruct_P clientStruct_p);
+
+
+/**	@brief 	Returns the time in milliseconds on the monotonic clock. 
+*	@param 	no parameter is passed. 
+*	@return returns the time in milliseconds. 
+*/
+long long now_Ms(void);
+
+
+/**	@brief 	Modifies the sent message and return the modified message to the client. 
+*	@param 	clientaddr is a structure containing the connected client identification and the
+*			message that was sent to the server to be processed. 
+*			recvMesg is a char array containing the client message that was sent to the server. 
+*	@return returns nothing. 
+*/
+void handleMessage(ClientStruct_P clientaddr, char *recvMesg);
+
+
+/**	@brief 	Names the client for the server's log. 
+*	@param 	clientStruct_p is the connected client. 
+*	@return returns the client's IP address, or "local" for clients on a Unix domain socket. 
+*/
+char *client_Name(ClientStruct_P clientStruct_p);
+
+
+/**	@brief 	The client sent a <get-file>name</get-file> message and the file is sent from
+*			the root directory. The reply is <replyFile length="N">, the N bytes of the file
+*			and </replyFile>; only the header goes through *send, the file follows it. 
+*	@param 	clientStruct_p is the client, which is given the file to send. 
+*			*recvMesg is a char array containing the message with the file name. 
+*			*send is the char array representing the header or error sent back to the client. 
+*	@return returns nothing. 
+*/
+void fileMessage(ClientStruct_P clientStruct_p, char *recvMesg, char *send);
+
+
+/**	@brief 	The task that sends a file after the header of its reply, and then the end of the
+*			reply, waiting for the client's socket whenever it is full. A client that takes
+*			nothing for the send timeout (-t) is disconnected. 
+*	@param 	task is the task; its owner is the client and its frame a FileSend structure. 
+*	@return returns TASK_DONE or TASK_WAITING. 
+*/
+int send_File_Task(Task_P task);
+
+
+/**	@brief 	Gives back the file of a send_File_Task. 
+*	@param 	task is the task. 
+*	@return returns nothing. 
+*/
+void cleanup_File_Task(Task_P task);
 
 
 /*
@@ -134,6 +352,31 @@ int create_TCP_Socket(void){
 }
 
 
+/*
+ **************************************************
+ **************************************************
+ */
+int create_Unix_Socket(char *path, int type){
+  struct sockaddr_un servaddr;
+  int listensockfd = socket(AF_UNIX, type, 0);
+  if(listensockfd == -1)
+	printErrorMessage("Cannot Open Local Socket to Listen"); 
+  if(strlen(path) >= sizeof(servaddr.sun_path))
+	printErrorMessage("Local Socket Path Is Too Long");
+
+  memset((void *) &servaddr, 0, (size_t) sizeof(servaddr));
+  servaddr.sun_family = AF_UNIX;
+  strcpy(servaddr.sun_path, path);
+  //a socket file left behind by an earlier server would make bind fail
+  unlink(path);
+  if(bind(listensockfd, (struct sockaddr *) &servaddr, (socklen_t) sizeof(servaddr)) == -1)
+	printErrorMessage("Failed to Bind To Local Socket");  
+  if(listen(listensockfd, MAX_NUM_LISTENER_ALLOWED) == -1)
+	printErrorMessage("MAX Number of Connections Established");
+  return listensockfd;
+}
+
+
 /*
  **************************************************
  **************************************************
@@ -196,13 +439,18 @@ struct sockaddr_in listen_On_Socket(int listensockfd, struct sockaddr_in servadd
  */
 void print_Server_info(int listensockfd, struct hostent *hostptr, struct sockaddr_in servaddr){
   struct ifreq ifr;
+  struct in_addr address;
+  memset((void *) &ifr, 0, sizeof(ifr));
   ifr.ifr_addr.sa_family = AF_INET;
   strncpy(ifr.ifr_name, INTERFACE, IFNAMSIZ-1);
-  if(ioctl(listensockfd, SIOCGIFADDR, &ifr) == -1)
-	printErrorMessage("Cannot Get Server IP Address");
+  //a host without INTERFACE still runs the server; the address of its name is shown instead
+  if(ioctl(listensockfd, SIOCGIFADDR, &ifr) == 0)
+	address = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr;
+  else
+	memcpy(&address, hostptr->h_addr_list[0], sizeof(address));
   
   printf("\nHostname Name : %s\n", hostptr->h_name);
-  printf("Host IP Address : %s\n", inet_ntoa(((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr));
+  printf("Host IP Address : %s\n", inet_ntoa(address));
   printf("Host Port Number : %i\n\n", htons(servaddr.sin_port));
 }
 
@@ -211,26 +459,106 @@ void print_Server_info(int listensockfd, struct hostent *hostptr, struct sockadd
  **************************************************
  **************************************************
  */
-void run_Server(int listensockfd, struct sockaddr_in servaddr){
+void run_Server(int *listensockfds, int listenerCount, ServerOptions_P options){
   printf("Waiting for Clients ......\n\n");
-  struct sockaddr_in cliaddr;
+  struct pollfd listeners[MAX_LISTENERS];
+  struct sockaddr_storage cliaddr;
+  struct epoll_event event;
   socklen_t clilen = sizeof(cliaddr); 
-  while(1)
+  uint32_t connection = 0;
+  int i = 0, noDelay = 1, type = SOCK_STREAM;
+  socklen_t typeLength = sizeof(type);
+  Worker_P workers = NULL, worker = NULL;
+  sigset_t stopSignals, previous, waiting;
+  if(listenerCount > MAX_LISTENERS) listenerCount = MAX_LISTENERS;
+  for(i = 0; i < listenerCount; i++)
+  {
+	listeners[i].fd = listensockfds[i];
+	listeners[i].events = POLLIN;
+  }
+
+  //start the workers that serve the clients
+  configure_Rate_Limit(options->rate, options->burst);
+  proxying = (options->backends != NULL);
+  quiet = options->quiet;
+  sendTimeout = options->sendTimeout;
+  //only this thread takes the signals that stop the server, and only while it waits in ppoll,
+  //so a signal that comes after the check of stopping still ends the wait instead of being missed
+  sigemptyset(&stopSignals);
+  sigaddset(&stopSignals, SIGINT);
+  sigaddset(&stopSignals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stopSignals, &previous);
+  workers = (Worker_P) calloc(options->workers, sizeof(Worker_T));
+  stopfd = eventfd(0, EFD_NONBLOCK);
+  if(workers == NULL || stopfd == -1)
+	printErrorMessage("Cannot Allocate Worker Threads");
+  event.events = EPOLLIN;
+  event.data.ptr = &stopKind;
+  for(i = 0; i < options->workers; i++)
+  {
+	workers[i].budget = options->budget;
+	workers[i].epollfd = epoll_create1(0);
+	if(workers[i].epollfd == -1 || epoll_ctl(workers[i].epollfd, EPOLL_CTL_ADD, stopfd, &event) == -1
+		|| pthread_create(&workers[i].tid, NULL, run_Worker, (void *) &workers[i]) != 0)
+		printErrorMessage("Cannot Start Worker Threads");
+  }
+  waiting = previous;
+  sigdelset(&waiting, SIGINT);
+  sigdelset(&waiting, SIGTERM);
+
+  while(!stopping)
   {
-	int connfd = accept(listensockfd,(struct sockaddr *)&cliaddr,&clilen);
-	if(connfd == -1)
-		printErrorMessage("Cannot Accept the Incoming Connections"); 
+	//wait until one of the listening sockets has a connection
+	if(ppoll(listeners, listenerCount, NULL, &waiting) == -1)
+	{
+		if(errno == EINTR) continue;
+		printErrorMessage("Cannot Wait for Incoming Connections");
+	}
+	for(i = 0; i < listenerCount; i++)
+	{
+		if(!(listeners[i].revents & POLLIN)) continue;
+		clilen = sizeof(cliaddr);
+		int connfd = accept(listeners[i].fd,(struct sockaddr *)&cliaddr,&clilen);
+		if(connfd == -1)
+			printErrorMessage("Cannot Accept the Incoming Connections"); 
+		//workers never wait on a single client, and replies go out as soon as a round is done
+		fcntl(connfd, F_SETFL, fcntl(connfd, F_GETFL) | O_NONBLOCK);
+		if(cliaddr.ss_family == AF_INET)
+			setsockopt(connfd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
 	
-	//thread id
-	int pthread_error = 0;
-	pthread_t tid;
-	ClientStruct_T clientStruct_t;
-	ClientStruct_P clientStruct_p = &clientStruct_t;
-	clientStruct_p->confd = connfd;
-	clientStruct_p->clientaddr = cliaddr;
-	pthread_error = pthread_create(&tid,NULL, receiveMessage, (void *) clientStruct_p);
-	if(pthread_error == 0) pthread_detach(tid);
+		ClientStruct_P clientStruct_p = (ClientStruct_P) calloc(1, sizeof(ClientStruct_T));
+		if(clientStruct_p == NULL)
+			printErrorMessage("Cannot Allocate Client Connection");
+		clientStruct_p->kind = EVENT_CLIENT;
+		clientStruct_p->confd = connfd;
+		clientStruct_p->connection = ++connection;
+		clientStruct_p->clientaddr = cliaddr;
+		clientStruct_p->rateKey = rate_Key(&cliaddr, connfd);
+		typeLength = sizeof(type);
+		clientStruct_p->stream = (getsockopt(connfd, SOL_SOCKET, SO_TYPE, &type, &typeLength) == -1 || type != SOCK_SEQPACKET);
+		//hand the clients to the workers in turn
+		worker = &workers[connection % options->workers];
+		clientStruct_p->worker = worker;
+		clientStruct_p->events = EPOLLIN;
+		event.events = EPOLLIN;
+		event.data.ptr = clientStruct_p;
+		__sync_fetch_and_add(&stats.connections, 1);
+		__sync_fetch_and_add(&stats.active, 1);
+		if(epoll_ctl(worker->epollfd, EPOLL_CTL_ADD, connfd, &event) == -1)
+		{
+			__sync_fetch_and_sub(&stats.active, 1);
+			close(connfd);
+			free(clientStruct_p);
+		}
+	}
   }
+
+  //wake every worker and wait until it has stopped, so none is still recording to the
+  //capture file when it is closed at exit
+  eventfd_write(stopfd, 1);
+  for(i = 0; i < options->workers; i++)
+	pthread_join(workers[i].tid, NULL);
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
 }
 
 
@@ -238,26 +566,641 @@ void run_Server(int listensockfd, struct sockaddr_in servaddr){
  **************************************************
  **************************************************
  */
-void *receiveMessage( void * param){
-  ClientStruct_P clientStruct_p = (ClientStruct_P) param;
+void stop_Server(int signum){
+  stopping = 1;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void *run_Worker( void * param){
+  Worker_P worker = (Worker_P) param;
+  struct epoll_event events[MAX_EVENTS];
+  ClientStruct_P clientStruct_p = NULL;
+  int count = 0, timeout = 0, result = 0, i = 0, check = 0;
+
+  worker->proxy = create_Proxy_Pool(worker->epollfd, deliver_Proxy_Reply);
+  while(!stopping)
+  {
+	//sleep until a client needs serving, unless some are still waiting for their turn
+	timeout = expire_Deadlines(worker);
+	if(worker->proxy != NULL)
+	{
+		check = proxy_Check(worker->proxy);
+		if(timeout == -1 || check < timeout) timeout = check;
+	}
+	if(worker->readyCount > 0) timeout = 0;
+	count = epoll_wait(worker->epollfd, events, MAX_EVENTS, timeout);
+	if(count == -1)
+	{
+		if(errno == EINTR) continue;
+		printErrorMessage("Cannot Wait for Clients");
+	}
+	for(i = 0; i < count; i++)
+	{
+		//a waiting handler's descriptor wakes the client the handler works for
+		if(*(int *) events[i].data.ptr == EVENT_STOP)
+			continue;
+		else if(*(int *) events[i].data.ptr == EVENT_BACKEND)
+			proxy_Event(worker->proxy, events[i].data.ptr, events[i].events);
+		else if(*(int *) events[i].data.ptr == EVENT_TASK)
+			schedule_Client(worker, (ClientStruct_P) ((Task_P) events[i].data.ptr)->owner);
+		else
+			schedule_Client(worker, (ClientStruct_P) events[i].data.ptr);
+	}
+
+	//one round: every client that was ready gets one turn of at most the budget, so a client
+	//with a long pipeline of requests cannot hold up the others served by this worker
+	for(count = worker->readyCount; count > 0; count--)
+	{
+		clientStruct_p = worker->readyHead;
+		worker->readyHead = clientStruct_p->nextReady;
+		if(worker->readyHead == NULL) worker->readyTail = NULL;
+		worker->readyCount--;
+		clientStruct_p->ready = 0;
+		clientStruct_p->nextReady = NULL;
+
+		result = serve_Client(worker, clientStruct_p);
+		if(result == CLIENT_CLOSED)
+			close_Client(worker, clientStruct_p);
+		else if(result == CLIENT_BUSY)
+		{
+			__sync_fetch_and_add(&stats.budgetYields, 1);
+			schedule_Client(worker, clientStruct_p);
+		}
+	}
+	//the requests the round forwarded go out in one write per backend
+	if(worker->proxy != NULL) proxy_Flush(worker->proxy);
+  }
+  return NULL;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int serve_Client(Worker_P worker, ClientStruct_P clientStruct_p){
+  int requestLength = 0, byteReceivedCount = 0, served = 0, closing = clientStruct_p->draining, more = MORE_WAITING;
+  long waitMs = 0;
+  int result = 0;
+
+  //a waiting handler goes on first, since its reply comes before any later one
+  result = run_Client_Task(worker, clientStruct_p);
+  if(result != CLIENT_READY) return result;
+
+  //replies the client was too slow to take come first; no new requests until they are out
+  if(output_Pending(clientStruct_p))
+  {
+	if(flush_Output(clientStruct_p) == -1) return CLIENT_CLOSED;
+	if(output_Pending(clientStruct_p))
+	{
+		watch_Client(clientStruct_p, EPOLLOUT);
+		return CLIENT_IDLE;
+	}
+  }
+  if(clientStruct_p->throttled) return CLIENT_IDLE;
+  //the end of a stream stays readable, so a client that has stopped sending is not watched for it
+  watch_Client(clientStruct_p, clientStruct_p->draining ? 0 : EPOLLIN);
+
+  while(1)
+  {
+	//a client with too many replies still due from the backends is read from again once they come
+	if(clientStruct_p->slotCount >= MAX_PENDING_REPLIES)
+	{
+		watch_Client(clientStruct_p, 0);
+		break;
+	}
+	if(served == worker->budget)
+	{
+		if(flush_Output(clientStruct_p) == -1) return CLIENT_CLOSED;
+		return CLIENT_BUSY;
+	}
+	//the rest of a refused request is dropped before the next request is looked for
+	if(clientStruct_p->discarding) discard_Request(clientStruct_p);
+	requestLength = clientStruct_p->discarding ? 0 : nextRequestLength(clientStruct_p->message, clientStruct_p->messageLength, closing ? MORE_NONE : more);
+	//the packets of a seqpacket client end its requests, so a full buffer is taken as it is
+	if(requestLength == REQUEST_TOO_LONG && !clientStruct_p->stream) requestLength = clientStruct_p->messageLength;
+	if(requestLength == 0)
+	{
+		if(closing) break;
+		//receive more from the client, after any partial request left over from the last receive
+		byteReceivedCount = recv(clientStruct_p->confd, clientStruct_p->message + clientStruct_p->messageLength, MAX_MESSAGE - NEW_LINE - clientStruct_p->messageLength, MSG_DONTWAIT);
+		if(byteReceivedCount > 0)
+		{
+			clientStruct_p->messageLength += byteReceivedCount;
+			clientStruct_p->waitOver = 0;
+			clientStruct_p->deadline = 0;
+			more = MORE_WAITING;
+			continue;
+		}
+		if(byteReceivedCount == -1 && errno == EINTR) continue;
+		if(byteReceivedCount == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+		{
+			//the client stopped sending, so whatever is left is as complete as it gets
+			closing = 1;
+			continue;
+		}
+		//everything the client sent has been read
+		if(more == MORE_WAITING)
+		{
+			more = MORE_POSSIBLE;
+			continue;
+		}
+		if(clientStruct_p->messageLength == 0 || clientStruct_p->discarding) break;
+		//a request cut off at the end of a receive is taken as it is if the rest does not follow in time;
+		//only pipelining clients split requests across sends, so only they pay REQUEST_WAIT_MS for it
+		if(!clientStruct_p->waitOver && clientStruct_p->pipelining)
+		{
+			if(clientStruct_p->deadline == 0) set_Deadline(worker, clientStruct_p, now_Ms() + REQUEST_WAIT_MS);
+			break;
+		}
+		clientStruct_p->waitOver = 0;
+		requestLength = nextRequestLength(clientStruct_p->message, clientStruct_p->messageLength, MORE_NONE);
+	}
+
+	//a client over its rate limit is not read from again until its next token is due
+	if(!take_Rate_Token(clientStruct_p->rateKey, &waitMs))
+	{
+		__sync_fetch_and_add(&stats.rateLimited, 1);
+		clientStruct_p->throttled = 1;
+		set_Deadline(worker, clientStruct_p, now_Ms() + waitMs);
+		watch_Client(clientStruct_p, 0);
+		break;
+	}
+	if(requestLength == REQUEST_TOO_LONG)
+		refuse_Request(clientStruct_p);
+	else
+		handle_Request(clientStruct_p, requestLength);
+	served++;
+	//a handler that has to wait keeps the client until it is done
+	if(clientStruct_p->task != NULL)
+	{
+		result = run_Client_Task(worker, clientStruct_p);
+		if(result != CLIENT_READY) return result;
+	}
+  }
+
+  //send every reply of the round together
+  if(flush_Output(clientStruct_p) == -1) return CLIENT_CLOSED;
+  //a client that has stopped sending is closed only once every reply it is due has gone out
+  if(closing)
+  {
+	clientStruct_p->draining = 1;
+	if(!output_Pending(clientStruct_p) && (clientStruct_p->messageLength == 0 || clientStruct_p->discarding) && clientStruct_p->slotHead == NULL) return CLIENT_CLOSED;
+	watch_Client(clientStruct_p, 0);
+  }
+  if(output_Pending(clientStruct_p) && !clientStruct_p->throttled)
+	watch_Client(clientStruct_p, EPOLLOUT);
+  return CLIENT_IDLE;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int run_Client_Task(Worker_P worker, ClientStruct_P clientStruct_p){
+  Task_P task = clientStruct_p->task;
+  struct epoll_event event;
+  int result = 0;
+  if(task == NULL) return CLIENT_READY;
+
+  //whatever woke the task, it no longer waits for the rest
+  if(task->fd != -1 && task->fd != clientStruct_p->confd)
+	epoll_ctl(worker->epollfd, EPOLL_CTL_DEL, task->fd, NULL);
+  clientStruct_p->deadline = 0;
+  result = resume_Task(task);
+  task->timedOut = 0;
+  if(result == TASK_DONE)
+  {
+	result = task->failed ? CLIENT_CLOSED : CLIENT_READY;
+	clientStruct_p->task = NULL;
+	free_Task(task);
+	if(result == CLIENT_READY) watch_Client(clientStruct_p, EPOLLIN);
+	return result;
+  }
+
+  //the client itself is only watched when the task waits for its socket
+  watch_Client(clientStruct_p, (task->fd == clientStruct_p->confd) ? task->events : 0);
+  if(task->fd != -1 && task->fd != clientStruct_p->confd)
+  {
+	event.events = task->events;
+	event.data.ptr = task;
+	//descriptors epoll cannot watch, like regular files, are always ready
+	if(epoll_ctl(worker->epollfd, EPOLL_CTL_ADD, task->fd, &event) == -1)
+	{
+		task->fd = -1;
+		return CLIENT_BUSY;
+	}
+  }
+  if(task->timeout >= 0) set_Deadline(worker, clientStruct_p, now_Ms() + task->timeout);
+  else if(task->fd == -1) return CLIENT_BUSY;
+  return CLIENT_IDLE;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void handle_Request(ClientStruct_P clientStruct_p, int requestLength){
   char recvMesg[MAX_MESSAGE];
-  int byteReceivedCount = 1;
- 
-  //continue receiving from the currently connected client 
-  while(byteReceivedCount > 0) 
+  memset((void *) &recvMesg, 0, (size_t) sizeof(recvMesg));
+  memcpy(recvMesg, clientStruct_p->message, requestLength);
+  record_Capture(clientStruct_p->connection, clientStruct_p->message, requestLength);
+  if(clientStruct_p->worker->proxy != NULL)
+	proxy_Request(clientStruct_p, recvMesg, requestLength);
+  else
+	handleMessage(clientStruct_p, recvMesg);
+  __sync_fetch_and_add(&stats.requests, 1);
+  clientStruct_p->messageLength -= requestLength;
+  if(clientStruct_p->messageLength > 0) clientStruct_p->pipelining = 1;
+  memmove(clientStruct_p->message, clientStruct_p->message + requestLength, clientStruct_p->messageLength);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void refuse_Request(ClientStruct_P clientStruct_p){
+  if(!quiet) printf("Refused a request too long from : %s\n\n", client_Name(clientStruct_p));
+  queue_Reply(clientStruct_p, "<error>request too long</error>", strlen("<error>request too long</error>"));
+  __sync_fetch_and_add(&stats.requests, 1);
+  clientStruct_p->discarding = strncmp(clientStruct_p->message, "<echo>", ECHO_XML_START) ? DISCARD_LINE : DISCARD_ECHO;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void discard_Request(ClientStruct_P clientStruct_p){
+  char *message = clientStruct_p->message, *end = NULL, *tag = NULL;
+  int length = clientStruct_p->messageLength, dropped = 0;
+  if(length == 0) return;
+
+  end = memchr(message, '\n', length);
+  if(clientStruct_p->discarding == DISCARD_NEWLINE)
+  {
+	//all that may be left of an <echo> after its </echo> is the newline that belongs to it
+	dropped = (message[0] == '\n') ? NEW_LINE : 0;
+	clientStruct_p->discarding = DISCARD_NONE;
+  }
+  else if(clientStruct_p->discarding == DISCARD_ECHO && (tag = memmem(message, (end != NULL) ? end - message : length, "</echo>", ECHO_XML_END)) != NULL)
+  {
+	dropped = (tag - message) + ECHO_XML_END;
+	clientStruct_p->discarding = (dropped < length && message[dropped] == '\n') ? DISCARD_NONE : DISCARD_NEWLINE;
+	if(clientStruct_p->discarding == DISCARD_NONE) dropped += NEW_LINE;
+  }
+  else if(end != NULL)
   {
-	memset((void *) &recvMesg, 0, (size_t) sizeof(recvMesg));
-	socklen_t clilen = sizeof(clientStruct_p->clientaddr);
+	dropped = (end - message) + NEW_LINE;
+	clientStruct_p->discarding = DISCARD_NONE;
+  }
+  //the start of a </echo> split across receives is kept until the rest comes
+  else if(clientStruct_p->discarding == DISCARD_ECHO)
+	dropped = (length >= ECHO_XML_END) ? length - (ECHO_XML_END - 1) : 0;
+  else
+	dropped = length;
+
+  clientStruct_p->messageLength -= dropped;
+  memmove(message, message + dropped, clientStruct_p->messageLength);
+}
 
-  	//receive message from client 
-  	byteReceivedCount = recvfrom(clientStruct_p->confd, recvMesg, MAX_MESSAGE, 0,(struct sockaddr *) &clientStruct_p->clientaddr, &clilen);
 
- 	//only if client sent a message does it need processing
-	if(byteReceivedCount > 0)
- 		handleMessage(clientStruct_p, recvMesg);
-   }
-  close(clientStruct_p->confd); 
-  pthread_exit(0);
+/*
+ **************************************************
+ **************************************************
+ */
+void queue_Reply(ClientStruct_P clientStruct_p, char *reply, int length){
+  ProxySlot_P slot = NULL;
+  if(clientStruct_p->slotHead != NULL) slot = (ProxySlot_P) calloc(1, sizeof(ProxySlot_T));
+  if(slot != NULL) slot->reply = (char *) malloc(length);
+  if(slot == NULL || slot->reply == NULL)
+  {
+	//nothing is waiting for the backends, or there is no memory to wait in line
+	free(slot);
+	append_Output(clientStruct_p, reply, length);
+	return;
+  }
+  memcpy(slot->reply, reply, length);
+  slot->replyLength = length;
+  slot->done = 1;
+  slot->owner = clientStruct_p;
+  clientStruct_p->slotTail->next = slot;
+  clientStruct_p->slotTail = slot;
+  clientStruct_p->slotCount++;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void proxy_Request(ClientStruct_P clientStruct_p, char *request, int requestLength){
+  char sendMesg[MAX_REPLY];
+  ProxySlot_P slot = NULL;
+  if(!strncmp(request, "<stats/>", STATS_XML))
+  {
+	memset((void *) &sendMesg, 0, (size_t) sizeof(sendMesg));
+	statsMessage(request, sendMesg);
+	queue_Reply(clientStruct_p, sendMesg, strlen(sendMesg));
+	return;
+  }
+  //every packet of a SOCK_SEQPACKET client is a whole reply, and files do not fit in one
+  if(!clientStruct_p->stream && !strncmp(request, "<get-file>", GET_FILE_XML_START))
+  {
+	queue_Reply(clientStruct_p, "<error>file needs a stream connection</error>", strlen("<error>file needs a stream connection</error>"));
+	return;
+  }
+  slot = (ProxySlot_P) calloc(1, sizeof(ProxySlot_T));
+  if(slot == NULL)
+  {
+	queue_Reply(clientStruct_p, "<error>server busy</error>", strlen("<error>server busy</error>"));
+	return;
+  }
+  slot->owner = clientStruct_p;
+  if(clientStruct_p->slotTail != NULL) clientStruct_p->slotTail->next = slot;
+  else clientStruct_p->slotHead = slot;
+  clientStruct_p->slotTail = slot;
+  clientStruct_p->slotCount++;
+  proxy_Forward(clientStruct_p->worker->proxy, slot, request, requestLength);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void deliver_Proxy_Reply(ProxySlot_P slot, char *reply, int length){
+  ClientStruct_P clientStruct_p = (ClientStruct_P) slot->owner;
+  if(clientStruct_p == NULL)
+  {
+	free(slot);
+	return;
+  }
+  //replies go out in the order of the client's requests, whichever backend answers first,
+  //so only a reply that comes before those of earlier requests is copied to wait for them
+  if(clientStruct_p->slotHead != slot)
+  {
+	slot->reply = (char *) malloc(length);
+	if(slot->reply != NULL) memcpy(slot->reply, reply, length);
+	slot->replyLength = (slot->reply != NULL) ? length : 0;
+	return;
+  }
+  append_Output(clientStruct_p, reply, length);
+  while(1)
+  {
+	clientStruct_p->slotHead = slot->next;
+	if(clientStruct_p->slotHead == NULL) clientStruct_p->slotTail = NULL;
+	clientStruct_p->slotCount--;
+	free(slot->reply);
+	free(slot);
+	slot = clientStruct_p->slotHead;
+	if(slot == NULL || !slot->done) break;
+	append_Output(clientStruct_p, slot->reply, slot->replyLength);
+  }
+  schedule_Client(clientStruct_p->worker, clientStruct_p);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void schedule_Client(Worker_P worker, ClientStruct_P clientStruct_p){
+  if(clientStruct_p->ready || clientStruct_p->throttled) return;
+  clientStruct_p->ready = 1;
+  clientStruct_p->nextReady = NULL;
+  if(worker->readyTail != NULL) worker->readyTail->nextReady = clientStruct_p;
+  else worker->readyHead = clientStruct_p;
+  worker->readyTail = clientStruct_p;
+  worker->readyCount++;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void set_Deadline(Worker_P worker, ClientStruct_P clientStruct_p, long long deadline){
+  clientStruct_p->deadline = deadline;
+  if(clientStruct_p->timed) return;
+  clientStruct_p->timed = 1;
+  clientStruct_p->nextTimed = worker->timed;
+  worker->timed = clientStruct_p;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int expire_Deadlines(Worker_P worker){
+  ClientStruct_P *link = &worker->timed, clientStruct_p = NULL;
+  long long now = now_Ms(), next = -1;
+  while(*link != NULL)
+  {
+	clientStruct_p = *link;
+	//clients whose wait was called off are only taken off the list here
+	if(clientStruct_p->deadline != 0 && clientStruct_p->deadline > now)
+	{
+		if(next == -1 || clientStruct_p->deadline < next) next = clientStruct_p->deadline;
+		link = &clientStruct_p->nextTimed;
+		continue;
+	}
+	*link = clientStruct_p->nextTimed;
+	clientStruct_p->timed = 0;
+	if(clientStruct_p->deadline == 0) continue;
+	clientStruct_p->deadline = 0;
+	if(clientStruct_p->throttled)
+	{
+		clientStruct_p->throttled = 0;
+		watch_Client(clientStruct_p, EPOLLIN);
+	}
+	else if(clientStruct_p->task != NULL)
+		clientStruct_p->task->timedOut = 1;
+	else
+		clientStruct_p->waitOver = 1;
+	schedule_Client(worker, clientStruct_p);
+  }
+  return (next == -1) ? -1 : (int) (next - now);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void watch_Client(ClientStruct_P clientStruct_p, uint32_t events){
+  struct epoll_event event;
+  if(clientStruct_p->events == events) return;
+  event.events = events;
+  event.data.ptr = clientStruct_p;
+  epoll_ctl(clientStruct_p->worker->epollfd, EPOLL_CTL_MOD, clientStruct_p->confd, &event);
+  clientStruct_p->events = events;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int append_Output(ClientStruct_P clientStruct_p, char *reply, int length){
+  char *output = NULL;
+  int capacity = clientStruct_p->outputCapacity, header = clientStruct_p->stream ? 0 : sizeof(int);
+  if(clientStruct_p->outputLength + header + length > capacity)
+  {
+	while(clientStruct_p->outputLength + header + length > capacity) capacity = capacity ? capacity * 2 : MAX_REPLY * DEFAULT_BUDGET;
+	output = (char *) realloc(clientStruct_p->output, capacity);
+	if(output == NULL) return -1;
+	clientStruct_p->output = output;
+	clientStruct_p->outputCapacity = capacity;
+  }
+  //a seqpacket client reads a reply per packet, so where each reply ends is kept
+  if(header > 0) memcpy(clientStruct_p->output + clientStruct_p->outputLength, &length, header);
+  memcpy(clientStruct_p->output + clientStruct_p->outputLength + header, reply, length);
+  clientStruct_p->outputLength += header + length;
+  return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int flush_Output(ClientStruct_P clientStruct_p){
+  int byteSentCount = 0, header = clientStruct_p->stream ? 0 : sizeof(int), length = 0;
+  while(clientStruct_p->outputSent < clientStruct_p->outputLength)
+  {
+	//a stream takes every reply at once, a seqpacket socket the next reply as one packet
+	length = clientStruct_p->outputLength - clientStruct_p->outputSent;
+	if(header > 0) memcpy(&length, clientStruct_p->output + clientStruct_p->outputSent, header);
+	//the socket is connected, so no address is given
+	byteSentCount = sendto(clientStruct_p->confd, clientStruct_p->output + clientStruct_p->outputSent + header, length, MSG_NOSIGNAL | MSG_DONTWAIT, NULL, 0);
+	if(byteSentCount == -1)
+	{
+		if(errno == EINTR) continue;
+		if(errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+		return -1;
+	}
+	clientStruct_p->outputSent += header + byteSentCount;
+  }
+  clientStruct_p->outputLength = clientStruct_p->outputSent = 0;
+  return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int output_Pending(ClientStruct_P clientStruct_p){
+  return clientStruct_p->outputSent < clientStruct_p->outputLength;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void close_Client(Worker_P worker, ClientStruct_P clientStruct_p){
+  ClientStruct_P *link = &worker->timed;
+  ProxySlot_P slot = NULL;
+  if(clientStruct_p->timed)
+  {
+	while(*link != clientStruct_p) link = &(*link)->nextTimed;
+	*link = clientStruct_p->nextTimed;
+  }
+  //a waiting handler is dropped, and its descriptor is no longer watched
+  if(clientStruct_p->task != NULL)
+  {
+	if(clientStruct_p->task->fd != -1 && clientStruct_p->task->fd != clientStruct_p->confd)
+		epoll_ctl(worker->epollfd, EPOLL_CTL_DEL, clientStruct_p->task->fd, NULL);
+	free_Task(clientStruct_p->task);
+  }
+  //replies still due from the backends are freed when they come
+  while(clientStruct_p->slotHead != NULL)
+  {
+	slot = clientStruct_p->slotHead;
+	clientStruct_p->slotHead = slot->next;
+	if(slot->done)
+	{
+		free(slot->reply);
+		free(slot);
+	}
+	else
+		slot->owner = NULL;
+  }
+  close(clientStruct_p->confd);
+  free(clientStruct_p->output);
+  free(clientStruct_p);
+  __sync_fetch_and_sub(&stats.active, 1);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+long long now_Ms(void){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int nextRequestLength(char *buffer, int length, int more){
+  char *end = NULL, *line = NULL;
+  int requestLength = 0, limit = 0, rest = 0;
+  if(length <= 0) return 0;
+
+  //<echo> requests end at the closing tag, so the message may itself contain newlines
+  if(length >= ECHO_XML_START && !strncmp(buffer, "<echo>", ECHO_XML_START))
+  {
+	end = memmem(buffer + ECHO_XML_START, length - ECHO_XML_START, "</echo>", ECHO_XML_END);
+	limit = (end != NULL) ? end - buffer : length;
+	//but a newline followed by the start of another request ends an <echo> that was never closed
+	for(line = memchr(buffer, '\n', limit); line != NULL; line = memchr(line + NEW_LINE, '\n', limit - (line + NEW_LINE - buffer)))
+	{
+		rest = length - (line + NEW_LINE - buffer);
+		if((rest >= ECHO_XML_START && !strncmp(line + NEW_LINE, "<echo>", ECHO_XML_START)) || (rest >= LOADAVG_XML && !strncmp(line + NEW_LINE, "<loadavg/>", LOADAVG_XML))
+			|| (rest >= GET_FILE_XML_START && !strncmp(line + NEW_LINE, "<get-file>", GET_FILE_XML_START)))
+			return (line - buffer) + NEW_LINE;
+	}
+	if(end != NULL) requestLength = (end - buffer) + ECHO_XML_END;
+	else if(more && length < MAX_MESSAGE - NEW_LINE) return 0;
+  }
+  //<loadavg/> and <stats/> requests are just the tag
+  else if(length >= LOADAVG_XML && !strncmp(buffer, "<loadavg/>", LOADAVG_XML))
+	requestLength = LOADAVG_XML;
+  else if(length >= STATS_XML && !strncmp(buffer, "<stats/>", STATS_XML))
+	requestLength = STATS_XML;
+
+  //anything else, or an <echo> that is never closed, runs to the end of the line
+  if(requestLength == 0)
+  {
+	end = memchr(buffer, '\n', length);
+	if(end != NULL) return (end - buffer) + NEW_LINE;
+	//the client has stopped sending, so the request is taken as it is
+	if(!more) return length;
+	//wait for the rest of the request unless it cannot fit in the buffer
+	return (length < MAX_MESSAGE - NEW_LINE) ? 0 : REQUEST_TOO_LONG;
+  }
+
+  //a newline directly after the request belongs to it, so if the request fills the buffer
+  //and the client has already sent more, the newline may be waiting in the next receive
+  if(requestLength == length && more == MORE_WAITING && length < MAX_MESSAGE - NEW_LINE) return 0;
+  if(requestLength < length && buffer[requestLength] == '\n') requestLength += NEW_LINE;
+  return requestLength;
 }
 
 
@@ -266,26 +1209,43 @@ void *receiveMessage( void * param){
  **************************************************
  */
 void handleMessage(ClientStruct_P clientStruct_p, char *recvMesg){
-  int byteSentCount = 0; 
-  char sendMesg[MAX_MESSAGE];
-  socklen_t clilen = sizeof(clientStruct_p->clientaddr);
+  char sendMesg[MAX_REPLY];
   memset((void *) &sendMesg, 0, (size_t) sizeof(sendMesg));
   
   //remove newline character at ending if present
   if(recvMesg[ ( strlen(recvMesg) - NEW_LINE ) ]  == '\n') recvMesg[ ( strlen(recvMesg) - NEW_LINE ) ] = '\0';
   
   //print client message
-  printf("***************************************************\n");
-  printf("Received the following message from : %s\n%s\n", inet_ntoa(((struct sockaddr_in *) &(clientStruct_p->clientaddr))->sin_addr), recvMesg);
+  if(!quiet)
+  {
+	printf("***************************************************\n");
+	printf("Received the following message from : %s\n%s\n", client_Name(clientStruct_p), recvMesg);
+  }
   
-  //modify the incoming message 
-  modifyMessage(recvMesg, sendMesg);
+  //modify the incoming message; a file is sent after the header of its reply
+  if(!strncmp(recvMesg, "<get-file>", GET_FILE_XML_START))
+	fileMessage(clientStruct_p, recvMesg, sendMesg);
+  else
+	modifyMessage(recvMesg, sendMesg);
  
-  //send the client the modified message
-  byteSentCount = sendto(clientStruct_p->confd, sendMesg, strlen(sendMesg), 0, (struct sockaddr *) &clientStruct_p->clientaddr, clilen);
+  //queue the modified message; the replies of a round are sent to the client together
+  append_Output(clientStruct_p, sendMesg, strlen(sendMesg));
   
-  printf("Sent the following message to : %s\n%s", inet_ntoa(((struct sockaddr_in *) &(clientStruct_p->clientaddr))->sin_addr), sendMesg);
-  printf("\n***************************************************\n\n");
+  if(!quiet)
+  {
+	printf("Sent the following message to : %s\n%s", client_Name(clientStruct_p), sendMesg);
+	printf("\n***************************************************\n\n");
+  }
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+char *client_Name(ClientStruct_P clientStruct_p){
+  if(clientStruct_p->clientaddr.ss_family == AF_UNIX) return "local";
+  return inet_ntoa(((struct sockaddr_in *) &(clientStruct_p->clientaddr))->sin_addr);
 }
 
 
@@ -301,6 +1261,9 @@ void modifyMessage(char *recvMesg, char *send){
   //handle <loadavg/> messages
   else if(!strncmp(recvMesg, "<loadavg/>", LOADAVG_XML))
    	loadavgMessage(recvMesg, sendMesg); 
+  //handle <stats/> messages
+  else if(!strncmp(recvMesg, "<stats/>", STATS_XML))
+   	statsMessage(recvMesg, sendMesg); 
   //handle error messages
   else	
 	errorMessage(recvMesg, sendMesg); 
@@ -322,7 +1285,7 @@ void echoMessage(char *recvMesg, char *send){
   {
 	strcpy(sendMesg, "<reply>");
 	strncpy(modifiedReceiveMessage, recvMesg + ECHO_XML_START, strlen(recvMesg) - (ECHO_XML_START + ECHO_XML_END));
-	strcat(sendMesg, modifiedReceiveMessage);
+	escapeMessage(modifiedReceiveMessage, sendMesg + strlen(sendMesg));
 	strcat(sendMesg, "</reply>");
   }
   else	
@@ -351,6 +1314,103 @@ void loadavgMessage(char *recvMesg, char *send){
 }
 
 
+/*
+ **************************************************
+ **************************************************
+ */
+void statsMessage(char *recvMesg, char *send){
+  char *sendMesg = send;
+  char proxyStats[MAX_MESSAGE] = "";
+  //a proxy also reports its backends
+  if(proxying) proxy_Stats(proxyStats);
+  sprintf(sendMesg, "<replyStats>connections=%lu active=%lu requests=%lu budgetYields=%lu rateLimited=%lu%s</replyStats>",
+	stats.connections, stats.active, stats.requests, stats.budgetYields, stats.rateLimited, proxyStats);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void fileMessage(ClientStruct_P clientStruct_p, char *recvMesg, char *send){
+  char *sendMesg = send, name[MAX_MESSAGE];
+  int length = strlen(recvMesg) - (GET_FILE_XML_START + GET_FILE_XML_END), error = 0;
+  FileEntry_P file = NULL;
+  memset((void *) &name, 0, (size_t) sizeof(name));
+  if(length < 0 || strcmp(recvMesg + GET_FILE_XML_START + length, "</get-file>"))
+  {
+	errorMessage(recvMesg, sendMesg);
+	return;
+  }
+  //every packet of a SOCK_SEQPACKET client is a whole reply, and files do not fit in one
+  if(!clientStruct_p->stream)
+  {
+	strcpy(sendMesg, "<error>file needs a stream connection</error>");
+	return;
+  }
+  strncpy(name, recvMesg + GET_FILE_XML_START, length);
+  file = acquire_File(name, &error);
+  if(error == FILE_DISABLED)
+	strcpy(sendMesg, "<error>file serving disabled</error>");
+  else if(file == NULL)
+	strcpy(sendMesg, "<error>file not found</error>");
+  else
+  {
+	//the file is sent by a task that waits for the client's socket without holding up the worker
+	clientStruct_p->task = create_Task(send_File_Task, cleanup_File_Task, clientStruct_p);
+	if(clientStruct_p->task == NULL)
+	{
+		release_File(file);
+		strcpy(sendMesg, "<error>server busy</error>");
+		return;
+	}
+	((FileSend_P) clientStruct_p->task->frame)->file = file;
+	sprintf(sendMesg, "<replyFile length=\"%lld\">", (long long) file->size);
+  }
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int send_File_Task(Task_P task){
+  ClientStruct_P clientStruct_p = (ClientStruct_P) task->owner;
+  FileSend_P fileSend = (FileSend_P) task->frame;
+  int result = 0;
+  TASK_BEGIN(task);
+
+  //the replies before the file and the header of its own reply go first; every wait for
+  //the client's socket ends after sendTimeout, so a client that stops reading is let go
+  while(!task->timedOut && (result = flush_Output(clientStruct_p)) == 0 && output_Pending(clientStruct_p))
+	TASK_WAIT(task, clientStruct_p->confd, EPOLLOUT, sendTimeout);
+  if(result == -1 || task->timedOut) task->failed = 1;
+  if(task->failed) TASK_EXIT(task);
+
+  while(!task->timedOut && (result = send_File(clientStruct_p->confd, fileSend->file, &fileSend->sent)) == 0)
+	TASK_WAIT(task, clientStruct_p->confd, EPOLLOUT, sendTimeout);
+  if(result == -1 || task->timedOut) task->failed = 1;
+  if(task->failed) TASK_EXIT(task);
+
+  //the end of the reply is sent with the replies that follow it
+  release_File(fileSend->file);
+  fileSend->file = NULL;
+  if(append_Output(clientStruct_p, "</replyFile>", GET_FILE_REPLY_END) == -1) task->failed = 1;
+  TASK_END(task);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void cleanup_File_Task(Task_P task){
+  FileSend_P fileSend = (FileSend_P) task->frame;
+  if(fileSend->file != NULL) release_File(fileSend->file);
+  fileSend->file = NULL;
+}
+
+
 /*
  **************************************************
  **************************************************
@@ -377,4 +1437,25 @@ void reverseString(char *original){
 }
 
 
-
+/*
+ **************************************************
+ **************************************************
+ */
+void escapeMessage(char *original, char *escaped){
+  for(; *original != '\0'; original++)
+  {
+	if(*original == '<')
+	{
+		strcpy(escaped, "&lt;");
+		escaped += 4;
+	}
+	else if(*original == '&')
+	{
+		strcpy(escaped, "&amp;");
+		escaped += ESCAPE_EXPANSION;
+	}
+	else
+		*escaped++ = *original;
+  }
+  *escaped = '\0';
+}
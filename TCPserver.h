@@ -5,7 +5,8 @@
  * 	@author Daniel Davis
  * 	@bug No known bugs!
  */
- 
+
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <unistd.h>
 #include <netdb.h>
@@ -18,6 +19,20 @@
 #include <sys/ioctl.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include "TCPcapture.h"
+#include "TCPlimit.h"
+#include "TCPfile.h"
+#include "TCPtask.h"
+#include "TCPproxy.h"
 
 /*
  **************************************************
@@ -26,18 +41,64 @@
  */
  
 #define MAX_NUM_LISTENER_ALLOWED 1024
+#define MAX_LISTENERS 2
+#define REQUEST_WAIT_MS 20
+#define MORE_NONE 0
+#define MORE_POSSIBLE 1
+#define MORE_WAITING 2
+#define REQUEST_TOO_LONG -1
+#define DISCARD_NONE 0
+#define DISCARD_LINE 1
+#define DISCARD_ECHO 2
+#define DISCARD_NEWLINE 3
+#define MAX_EVENTS 256
+#define DEFAULT_BUDGET 16
+#define DEFAULT_SEND_TIMEOUT_MS 30000
+#define CLIENT_CLOSED 0
+#define CLIENT_IDLE 1
+#define CLIENT_BUSY 2
+#define CLIENT_READY 3
+#define EVENT_CLIENT 1
+#define EVENT_STOP 4
+#define MAX_PENDING_REPLIES 256
 #define INTERFACE "eth0"
 #define MAX_MESSAGE 256
+#define ESCAPE_EXPANSION 5
+#define MAX_REPLY (MAX_MESSAGE * ESCAPE_EXPANSION + 32)
 #define IP_4 32
 #define ECHO_XML_START 6
 #define ECHO_XML_END 7
 #define LOADAVG_XML 10
+#define STATS_XML 8
+#define GET_FILE_XML_START 10
+#define GET_FILE_XML_END 11
+#define GET_FILE_REPLY_END 12
 #define NEW_LINE 1
 #define LOAD_AVG_FUNCTION 3
 #define LOAD_AVG_1_MIN_INDEX 0
 #define LOAD_AVG_5_MIN_INDEX 1
 #define LOAD_AVG_15_MIN_INDEX 2
 
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	How the server serves its clients, set from the command line
+ */
+typedef struct ServerOptions{
+  int workers;	//worker threads serving the clients
+  int budget;	//requests served per client in each scheduling round
+  double rate;	//requests per second allowed per client address, 0 for no limit
+  double burst;	//requests a client address may send at once before the rate applies
+  char *fileRoot;	//directory that <get-file> serves files from, NULL for none
+  char *backends;	//servers to forward requests to in proxy mode, NULL to answer them here
+  int quiet;	//non zero to not print every request and reply
+  int sendTimeout;	//milliseconds a client may take none of a file being sent before it is disconnected
+}ServerOptions_T, *ServerOptions_P;
+
 /*
  **************************************************
  *		FUNCTION PROTOTYPES
@@ -50,6 +111,14 @@
 */
 int create_TCP_Socket(void);
 
+/**	@brief	Function create a Unix domain socket for clients on the same host, bind it to a
+*			path and listen on it. A stale socket file left at the path is removed first.
+*	@param	path is the file system path of the socket.
+*			type is SOCK_STREAM, or SOCK_SEQPACKET to keep every request and reply a separate packet.
+*	@return a integer representing the listening socket number.
+*/
+int create_Unix_Socket(char *path, int type);
+
 /**	@brief 	Get the host that the server is running on and returns it in the stuct hostent.
 *	@param 	no parameter is passed. 
 *	@return returns a pointer to a hostent structure containing information about the server's host.
@@ -77,6 +146,7 @@ struct sockaddr_in bind_Socket(int listensockfd, struct sockaddr_in servaddr);
 struct sockaddr_in listen_On_Socket(int listensockfd, struct sockaddr_in servaddr);
 
 /**	@brief 	Prints the host name, IP address, and port number that the server is running on. 
+*			The IP address is that of INTERFACE, or of the host name on hosts without it. 
 *	@param 	listensockfd is the socket that the server will listen on. 
 *			hostptr contains information about the host the server is running on.
 *			servaddr is a sockaddr_in structure that contains information about the host running the server. 
@@ -85,10 +155,90 @@ struct sockaddr_in listen_On_Socket(int listensockfd, struct sockaddr_in servadd
 void print_Server_info(int listensockfd, struct hostent *hostptr, struct sockaddr_in servaddr);
 
 /**	@brief 	Function to accept connections and wait if the server is full of request. 
-*			Creates detached threads to handle the request from client. 
-*	@param 	listensockfd is the socket that the server will listen on. 
-*			servaddr is a sockaddr_in structure that contains information about the host running the server. 
-*	@return returns nothing.
+*			Starts the worker threads and hands every new client to one of them in turn. 
+*	@param 	listensockfds are the sockets that the server will listen on, TCP and local alike. 
+*			listenerCount is the number of listening sockets, at most MAX_LISTENERS. 
+*			options are the number of workers, the budget per round and the rate limit. 
+*	@return returns nothing once stop_Server has been called and every worker has stopped,
+*			so nothing is recorded to the capture file after run_Server returns.
+*/
+void run_Server(int *listensockfds, int listenerCount, ServerOptions_P options);
+
+/**	@brief 	Signal handler that makes run_Server return, so the server exits normally and
+*			its exit handlers still run. 
+*	@param 	signum is the signal caught. 
+*	@return returns nothing. 
+*/
+void stop_Server(int signum);
+
+/**	@brief 	Finds the end of the first request in the bytes received from a client so that
+*			clients can pipeline several requests without waiting for each reply.
+*			An <echo> request ends at its </echo> tag, <loadavg/> ends after the tag and
+*			anything else ends at a newline. A single trailing newline belongs to the request.
+*	@param 	*buffer holds the bytes received from the client.
+*			length is the number of bytes in the buffer.
+*			more is MORE_NONE if the client has stopped sending, MORE_WAITING if it has already
+*			sent bytes that are not in the buffer and MORE_POSSIBLE otherwise.
+*	@return returns the length of the first request, 0 if the request is not complete yet and
+*			REQUEST_TOO_LONG if it fills the buffer without ending while the client is still sending.
+*/
+int nextRequestLength(char *buffer, int length, int more);
+
+/**	@brief 	Determines if the message is a valid ECHO or LOADAVG command or
+*			if the message is a error message, and makes decisions based upon this.
+*	@param 	*recvMesg is a char array containing the client message that was sent to the server.
+*			*send is the char array representing the message to be sent back to the client. 
+*	@return returns nothing. 
+*/
+void modifyMessage(char *recvMesg, char *send);
+
+/**	@brief 	The client sent a message in the ECHO header and should be returned to the client
+*			in REPLY headers. 
+*	@param 	*recvMesg is a char array containing the client message that was sent to the server. 
+*			*send is the char array representing the message to be sent back to the client. 
+*	@return returns nothing. 
+*/
+void echoMessage(char *recvMesg, char *send);
+
+/**	@brief 	The client sent the <loadavg/> message and therefore the load average
+*			on the server for 1:5:15 minutes.
+*	@param 	*recvMesg is a char array containing the keyword -> <loadavg/>
+*			*send is a char array containing the load average calculations. 
+*	@return returns nothing. 
+*/
+void loadavgMessage(char *recvMesg, char *send);
+
+/**	@brief 	The client sent the <stats/> message and therefore the server's counters: connections
+*			accepted and still open, requests served, rounds in which a client used up its budget
+*			and times a client had to wait for its rate limit.
+*	@param 	*recvMesg is a char array containing the keyword -> <stats/>
+*			*send is a char array containing the counters. 
+*	@return returns nothing. 
+*/
+void statsMessage(char *recvMesg, char *send);
+
+/**	@brief	The client sent the server a invalid message and must be returned
+*			to the client as a invalid input. 
+*	@param 	*recvMesg is a char array contains the message that the client sent to the server.
+*			*send is the char array representing the message to be sent back to the client. 
+*	@return	returns nothing. 
+*/
+void errorMessage(char *recvMesg, char *send);
+
+/**	@brief	Used to reverse a string pass into the function. 
+*	@param	*original is the string to reverse, it directly modifies this char array 
+*	@return	returns nothing. 
+*/
+void reverseString(char *original);
+
+/**	@brief	Copies the text of a message into a reply with '<' and '&' escaped as "&lt;" and
+*			"&amp;". Clients take the first closing tag they find as the end of a reply, so
+*			echoed text must never contain one of its own; they unescape the text again
+*			with unescapeResponse in TCPresponse.c.
+*	@param	*original is the text to escape.
+*			*escaped is filled in with the escaped text; it must have room for
+*			ESCAPE_EXPANSION times the length of the text.
+*	@return	returns nothing.
 */
-void run_Server(int listensockfd, struct sockaddr_in servaddr);
+void escapeMessage(char *original, char *escaped);
 
@@ -10,22 +10,111 @@
 #include "TCPserver.h"
 
 /**	@brief 	The main program for running the TCP server.
-*	@param 	no parameters. 
+*	@param 	-c <capture file> records every request to the capture file for later replay. 
+*			-p <port> listens on the port instead of one chosen by the system. 
+*			-u <socket path> also listens on a Unix domain socket for clients on the same host. 
+*			-s makes the Unix domain socket a SOCK_SEQPACKET socket instead of a stream. 
+*			-w <workers> is the number of worker threads, one per processor by default. 
+*			-b <budget> is the number of requests served per client in each round, DEFAULT_BUDGET by default. 
+*			-r <rate>[:<burst>] limits every client address to rate requests per second,
+*			with bursts of up to burst requests. 
+*			-f <root directory> serves the files in the directory to <get-file> requests. 
+*			-P <backends> forwards the requests to a comma separated list of servers, given
+*			as host:port or a local socket path. 
+*			-q does not print every request and reply. 
+*			-t <send timeout> disconnects a client that takes none of a file for this many
+*			milliseconds, DEFAULT_SEND_TIMEOUT_MS by default. 
 *	@return returns 0 to the OS when main completes. 
 */
-int main(){
+int main(int argc, char**argv){
 
-  int listensockfd;
+  int listensockfd, option, port = 0, reuse = 1, listenerCount = 0, localType = SOCK_STREAM;
+  int listensockfds[MAX_LISTENERS];
+  char *captureFile = NULL, *localPath = NULL;
   struct hostent *hostptr; 
   struct sockaddr_in servaddr;
+  ServerOptions_T options = { 0, DEFAULT_BUDGET, 0.0, 1.0, NULL, NULL, 0, DEFAULT_SEND_TIMEOUT_MS };
+  char *burst = NULL;
+
+  while((option = getopt(argc, argv, "c:p:u:sw:b:r:f:P:qt:")) != -1)
+  {
+	switch(option)
+	{
+		case 'c': captureFile = optarg; break;
+		case 'p': port = atoi(optarg); break;
+		case 'u': localPath = optarg; break;
+		case 's': localType = SOCK_SEQPACKET; break;
+		case 'w': options.workers = atoi(optarg); break;
+		case 'b': options.budget = atoi(optarg); break;
+		case 'r':
+			options.rate = atof(optarg);
+			burst = strchr(optarg, ':');
+			options.burst = (burst != NULL) ? atof(burst + 1) : options.rate;
+			break;
+		case 'f': options.fileRoot = optarg; break;
+		case 'P': options.backends = optarg; break;
+		case 'q': options.quiet = 1; break;
+		case 't': options.sendTimeout = atoi(optarg); break;
+		default:
+			fprintf(stderr, "./server [-c <Capture File>] [-p <Port>] [-u <Local Socket Path> [-s]] [-w <Workers>] [-b <Budget>] [-r <Rate>[:<Burst>]] [-f <File Root>] [-P <Backends>] [-q] [-t <Send Timeout>]\n");
+			return 1;
+	}
+  }
+
+  if(options.workers <= 0) options.workers = sysconf(_SC_NPROCESSORS_ONLN);
+  if(options.workers <= 0) options.workers = 1;
+  if(options.budget <= 0) options.budget = DEFAULT_BUDGET;
+  if(options.sendTimeout <= 0) options.sendTimeout = DEFAULT_SEND_TIMEOUT_MS;
+  if(options.rate < 0.0)
+  {
+	fprintf(stderr, "ERROR: Rate Limit Cannot Be Negative\n");
+	return 1;
+  }
+
+  if(options.fileRoot != NULL && open_File_Root(options.fileRoot) == -1)
+  {
+	fprintf(stderr, "ERROR: Cannot Serve Files From %s\n", options.fileRoot);
+	return 1;
+  }
+
+  if(options.backends != NULL && configure_Proxy(options.backends) == -1)
+  {
+	fprintf(stderr, "ERROR: Cannot Forward Requests To %s\n", options.backends);
+	return 1;
+  }
+
+  if(captureFile != NULL)
+  {
+	if(open_Capture(captureFile) == -1)
+	{
+		fprintf(stderr, "ERROR: Cannot Open Capture File %s\n", captureFile);
+		return 1;
+	}
+	atexit(close_Capture); //write out the last recorded requests once run_Server has stopped the workers
+  }
   
   listensockfd = create_TCP_Socket();  //create the TCP socket 
   hostptr = info_Host(); //get information about the host 
   servaddr = destination_Address(hostptr); //get the server ip address 
+  if(port > 0)
+  {
+	//a fixed port can be bound again right after a restart
+	servaddr.sin_port = htons((u_short) port);
+	setsockopt(listensockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  }
   servaddr = bind_Socket(listensockfd, servaddr); //bind a socket for the server program 
   servaddr = listen_On_Socket(listensockfd, servaddr); //listens on a specific socket 
   print_Server_info(listensockfd, hostptr, servaddr); //print connection information 
-  run_Server(listensockfd, servaddr); //run the server program and create detached pthreads for incoming client connections
+  listensockfds[listenerCount++] = listensockfd;
+
+  if(localPath != NULL)
+  {
+	listensockfds[listenerCount++] = create_Unix_Socket(localPath, localType); //listen for clients on this host 
+	printf("Local Socket : %s (%s)\n\n", localPath, (localType == SOCK_SEQPACKET) ? "seqpacket" : "stream");
+  }
+  //Ctrl-C and kill stop the server normally, so everything written at exit is written
+  signal(SIGINT, stop_Server);
+  signal(SIGTERM, stop_Server);
+  run_Server(listensockfds, listenerCount, &options); //run the server program and hand incoming client connections to the worker threads
   return 0;
 }
-
@@ -0,0 +1,78 @@
+/**	@file TCPtask.c
+ * 	@brief Contains the function implementations for running tasks and keeping a pool of
+ *	them for each worker thread. The pools are thread local, so taking a task and giving it
+ *	back never locks; a task is always freed by the worker that created it.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "TCPtask.h"
+
+/*
+ *	The tasks kept for reuse by the calling thread
+ */
+static __thread Task_P taskPool = NULL;
+static __thread int pooledTasks = 0;
+
+
+/*
+ **************************************************
+ *		TASK FUNCTIONS
+ **************************************************
+ */
+
+/*
+ **************************************************
+ **************************************************
+ */
+Task_P create_Task(TaskFunction run, TaskCleanup cleanup, void *owner){
+  Task_P task = taskPool;
+  if(task != NULL)
+  {
+	taskPool = task->nextFree;
+	pooledTasks--;
+  }
+  else
+  {
+	task = (Task_P) malloc(sizeof(Task_T));
+	if(task == NULL) return NULL;
+  }
+  memset((void *) task, 0, sizeof(Task_T));
+  task->kind = EVENT_TASK;
+  task->run = run;
+  task->cleanup = cleanup;
+  task->owner = owner;
+  task->fd = -1;
+  task->timeout = -1;
+  return task;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int resume_Task(Task_P task){
+  if(task->line == -1) return TASK_DONE;
+  return task->run(task);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void free_Task(Task_P task){
+  if(task->cleanup != NULL) task->cleanup(task);
+  if(pooledTasks == TASK_POOL_MAX)
+  {
+	free(task);
+	return;
+  }
+  task->nextFree = taskPool;
+  taskPool = task;
+  pooledTasks++;
+}
@@ -0,0 +1,132 @@
+/**	@file TCPtask.h
+ * 	@brief Contains the macros and function prototypes for handlers that wait without blocking
+ *	their worker thread, implemented in TCPtask.c
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+/*
+ * TCPtask.h
+ *
+ * A task is a handler written as one ordinary function that can stop in the middle to wait
+ * for a socket, a file descriptor or a timer and carry on later where it stopped. It is a
+ * stackless state machine: the TASK_ macros turn the function body into a switch on the line
+ * it last stopped at, so waiting is a return to the worker's event loop and resuming is a
+ * call of the same function. The worker that started a task is the one that resumes it.
+ *
+ * Local variables of the function do not survive a wait. Everything a task needs across
+ * waits lives in its frame, a block of TASK_FRAME_SIZE bytes the task casts to its own
+ * structure. Frames come from a pool kept by each worker thread, so starting a task does
+ * not normally allocate.
+ *
+ *	int exampleTask(Task_P task){
+ *	  Example_P example = (Example_P) task->frame;
+ *	  TASK_BEGIN(task);
+ *	  while(example->sent < example->length)
+ *	  {
+ *		...
+ *		TASK_WAIT_FD(task, example->sockfd, EPOLLOUT);
+ *	  }
+ *	  TASK_END(task);
+ *	}
+ *
+ * The waiting macros may not be used inside a switch statement of the task.
+ */
+
+#include <stdint.h>
+
+/*
+ **************************************************
+ *		COMPILER PRE DEFINES
+ **************************************************
+ */
+
+#define TASK_FRAME_SIZE 256
+#define TASK_POOL_MAX 64
+#define TASK_DONE 0
+#define TASK_WAITING 1
+#define EVENT_TASK 2
+
+//starts the body of a task; the body resumes after the wait it last stopped at
+#define TASK_BEGIN(task) switch((task)->line){ case 0:
+
+//ends the body of a task; a finished task is not run again
+#define TASK_END(task) } (task)->line = -1; return TASK_DONE;
+
+//waits until fd is ready for the epoll events or timeoutMs have passed; -1 for no fd or no timeout
+#define TASK_WAIT(task, waitfd, waitEvents, timeoutMs) \
+	do{ (task)->fd = (waitfd); (task)->events = (waitEvents); (task)->timeout = (timeoutMs); \
+		(task)->line = __LINE__; return TASK_WAITING; case __LINE__: (task)->fd = -1; (task)->timeout = -1; }while(0)
+
+#define TASK_WAIT_FD(task, waitfd, waitEvents) TASK_WAIT(task, waitfd, waitEvents, -1)
+#define TASK_SLEEP(task, timeoutMs) TASK_WAIT(task, -1, 0, timeoutMs)
+
+//gives the other clients of the worker a turn and carries on in the next round
+#define TASK_YIELD(task) TASK_WAIT(task, -1, 0, -1)
+
+//leaves the task early, as if it had reached TASK_END
+#define TASK_EXIT(task) do{ (task)->line = -1; return TASK_DONE; }while(0)
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+typedef struct Task Task_T, *Task_P;
+
+/*
+ *	The body of a task; returns TASK_WAITING after setting what it waits for, or TASK_DONE
+ */
+typedef int (*TaskFunction)(Task_P task);
+
+/*
+ *	Frees what a task still holds in its frame when the task is freed, done or not
+ */
+typedef void (*TaskCleanup)(Task_P task);
+
+struct Task{
+  int kind;	//always EVENT_TASK, so an epoll event can tell a task from a client
+  int line;	//where the task resumes, 0 before it has run and -1 once it is done
+  TaskFunction run;
+  TaskCleanup cleanup;
+  void *owner;	//the client the task works for
+  int fd;	//the descriptor the task waits for, -1 for none
+  uint32_t events;	//the epoll events it waits for
+  int timeout;	//milliseconds it waits at most, -1 for no limit
+  int timedOut;	//set when the task is resumed because its timeout passed
+  int failed;	//set by the task if its client has to be disconnected
+  Task_P nextFree;
+  union{
+	char frame[TASK_FRAME_SIZE];	//the task's state across waits
+	long long align;
+  };
+};
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Takes a task from the calling thread's pool, or allocates one if the pool is empty.
+*	@param 	run is the body of the task.
+*			cleanup frees what the frame still holds when the task is freed, or NULL.
+*			*owner is the client the task works for.
+*	@return returns the task with a zeroed frame, or NULL if there is not enough memory.
+*/
+Task_P create_Task(TaskFunction run, TaskCleanup cleanup, void *owner);
+
+/**	@brief 	Runs a task until it finishes or waits again.
+*	@param 	task is the task.
+*	@return returns TASK_DONE or TASK_WAITING.
+*/
+int resume_Task(Task_P task);
+
+/**	@brief 	Gives a task back to the calling thread's pool after calling its cleanup. A task
+*			may be freed before it is done, for instance when its client disconnects.
+*	@param 	task is the task.
+*	@return returns nothing.
+*/
+void free_Task(Task_P task);
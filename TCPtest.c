@@ -0,0 +1,1232 @@
+/**	@file TCPtest.c
+ * 	@brief Contains the main program for the loopback tests of the TCP server.
+ *	Starts the server on fixed ports of this host with the options each test needs, talks
+ *	to it over real sockets and checks the replies, the normal way and the failing way.
+ *	Prints PASS or FAIL for every check and exits with the number of failed checks.
+ * 	@author Cole Amick
+ * 	@author Daniel Davis
+ * 	@bug No known bugs!
+ */
+
+#include "TCPclientAsync.h"
+#include "TCPcapture.h"
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/prctl.h>
+
+/*
+ **************************************************
+ *		COMPILER PRE DEFINES
+ **************************************************
+ */
+
+#define TEST_PORT 7600
+#define TEST_BUFFER 65536
+#define TEST_TIMEOUT_MS 2000
+#define TEST_START_MS 5000
+#define TEST_MAX_OPTIONS 16
+#define TEST_PATH_MAX 512
+#define TEST_FILE_SIZE 3000
+#define TEST_ASYNC_REQUESTS 20
+#define TEST_POLLS 50
+#define TEST_PACKETS 8
+#define TEST_LARGE_FILE (4 * 1024 * 1024)
+#define PROXY_TIMEOUT_MS 2000	//as in TCPproxy.h
+#define REQUEST_WAIT_MS 20	//as in TCPserver.h
+#define NANOSECONDS_PER_MS 1000000ULL
+#define OVERSIZED_REQUEST 315	//longer than MAX_MESSAGE in TCPserver.h
+#define TEST_ESCAPED 200	//'&' in an echo whose escaped reply takes several receives
+#define TEST_REPLAY_GAP_MS 50	//between the two requests of the paced replay
+#define TEST_DRAIN_REQUESTS 400	//requests of a client that stops sending before it reads, fewer than its budget
+#define TEST_DRAIN_ECHO 240	//'&' in each of them, five bytes each in the reply
+#define TEST_SEND_TIMEOUT_MS 1000	//how long the server waits for a client that takes none of a file
+
+/*
+ **************************************************
+ *		STRUCTURES
+ **************************************************
+ */
+
+/*
+ *	A connection to the server and the bytes received on it that are not a response yet
+ */
+typedef struct TestConnection{
+  int sock;
+  char buffer[TEST_BUFFER];
+  int length;
+}TestConnection_T, *TestConnection_P;
+
+/*
+ *	What the callbacks of the asynchronous client tests were given
+ */
+typedef struct TestCallbacks{
+  int calls;
+  int status;
+  char response[MAX_MESSAGE];
+}TestCallbacks_T, *TestCallbacks_P;
+
+static char *serverProgram = "./server";
+static char *replayProgram = "./replay";
+static char testDirectory[] = "/tmp/loopback_testXXXXXX";	//files the tests make, removed at the end
+static int failures = 0;
+static int checks = 0;
+
+
+/*
+ **************************************************
+ *		FUNCTION PROTOTYPES
+ **************************************************
+ */
+
+/**	@brief 	Starts the server on a port with its output discarded and waits until it answers.
+*	@param 	port is the port the server listens on.
+*			**options are more options for the server, NULL terminated.
+*	@return returns the server's process id, or -1 if it did not start.
+*/
+pid_t startServer(int port, char **options);
+
+/**	@brief 	Stops a server with SIGTERM and waits for it to exit.
+*	@param 	server is the server's process id.
+*	@return returns the server's exit status, or -1 if it did not exit normally.
+*/
+int stopServer(pid_t server);
+
+/**	@brief 	Connects to a server on this host.
+*	@param 	connection is filled in with the connection.
+*			port is the server's port.
+*	@return returns 0 if connected, -1 otherwise.
+*/
+int openConnection(TestConnection_P connection, int port);
+
+/**	@brief 	Sends all of a request, or of several pipelined ones.
+*	@param 	connection is the connection.
+*			*request are the bytes to send.
+*	@return returns 0 if everything was sent, -1 otherwise.
+*/
+int sendAll(TestConnection_P connection, char *request);
+
+/**	@brief 	Waits for the next whole response, framed the way the clients frame them.
+*	@param 	connection is the connection.
+*			*response is filled in with the NUL terminated response.
+*			capacity is the size of response.
+*			timeoutMs is how long to wait for it.
+*	@return returns the length of the response, or -1 if none came in time or the server closed.
+*/
+int readResponse(TestConnection_P connection, char *response, int capacity, int timeoutMs);
+
+/**	@brief 	Waits for the next packet on a SOCK_SEQPACKET connection.
+*	@param 	sock is the connection.
+*			*packet is filled in with the NUL terminated packet.
+*			capacity is the size of packet.
+*			timeoutMs is how long to wait for it.
+*	@return returns the length of the packet, or -1 if none came in time or the server closed.
+*/
+int readPacket(int sock, char *packet, int capacity, int timeoutMs);
+
+/**	@brief 	Records the outcome of one check and prints it.
+*	@param 	passed is non zero if the check passed.
+*			*test is the name of the test.
+*			*what describes the check.
+*	@return returns passed.
+*/
+int expect(int passed, char *test, char *what);
+
+/**	@brief 	Reads the next response and checks that it is the expected one.
+*	@param 	connection is the connection.
+*			*test is the name of the test.
+*			*expected is the whole response expected, or the start of it if prefix is non zero.
+*			prefix is non zero to only compare the start of the response.
+*	@return returns non zero if the response was the expected one.
+*/
+int expectResponse(TestConnection_P connection, char *test, char *expected, int prefix);
+
+/**	@brief 	Listens on a port of this host in place of a server, for tests that need a
+*			server which misbehaves.
+*	@param 	port is the port.
+*	@return returns the listening socket, or -1 if it cannot listen.
+*/
+int listenLoopback(int port);
+
+/**	@brief 	Records a response given to an asynchronous client callback.
+*	@param 	context is the TestCallbacks structure; the rest are those of AsyncCallback.
+*	@return returns nothing.
+*/
+void recordCallback(void * context, int id, int status, char * response);
+
+/**	@brief 	Runs a program with the shell and collects what it prints.
+*	@param 	*command is the command line; stderr is collected too.
+*			*output is filled in with the NUL terminated output.
+*			capacity is the size of output.
+*	@return returns the program's exit status, or -1 if it could not run.
+*/
+int runProgram(char *command, char *output, int capacity);
+
+/**	@brief 	Creates a file in the test directory.
+*	@param 	*name is the file's path in the test directory.
+*			*data and length are its contents.
+*	@return returns 0 if the file was written, -1 otherwise.
+*/
+int writeTestFile(char *name, char *data, int length);
+
+/**	@brief 	Names a path in the test directory.
+*	@param 	*name is the path in the test directory.
+*			*path is filled in with the whole path, TEST_PATH_MAX bytes at most.
+*	@return returns path.
+*/
+char *testPath(char *name, char *path);
+
+/**	@brief 	Reads the monotonic clock.
+*	@param 	no parameter is passed.
+*	@return returns the time in nanoseconds.
+*/
+uint64_t testClock(void);
+
+/**	@brief 	Pipelined requests are framed and answered in order, an echoed closing tag
+*			cannot end its reply early and a request too long for the server gets a single error.
+*			The clients unescape echoed text, so it comes back as it was sent.
+*	@param 	port is the port of a server with default options.
+*	@return returns nothing.
+*/
+void testPipelining(int port);
+
+/**	@brief 	Requests are captured up to the moment the server is stopped, and the capture
+*			replays, large file replies included; damaged captures are refused or cut short. The replay sends every request at its recorded time, without
+*			waiting for the replies before it.
+*	@param 	port is a free port for the servers the test starts.
+*	@return returns nothing.
+*/
+void testCapture(int port);
+
+/**	@brief 	The asynchronous client pairs pipelined responses with their requests, and a
+*			response that no request is waiting for fails the connection instead of being
+*			handed to another request.
+*	@param 	port is the port of a server with default options.
+*			fakePort is a free port for a fake server.
+*	@return returns nothing.
+*/
+void testAsyncClient(int port, int fakePort);
+
+/**	@brief 	Clients on this host are served through a Unix domain stream or seqpacket socket,
+*			and a socket path the server cannot bind stops it with an error.
+*	@param 	port is a free port for the servers the test starts.
+*	@return returns nothing.
+*/
+void testLocalSockets(int port);
+
+/**	@brief 	Workers answer a seqpacket client one packet per reply even when it pipelines,
+*			slow a client down to its rate limit, make a client that used its whole
+*			budget wait for the next round and send a client that has stopped sending
+*			every reply before they close it.
+*	@param 	port is a free port for the servers the test starts.
+*	@return returns nothing.
+*/
+void testWorkers(int port);
+
+/**	@brief 	Asks a server for one of the counters of its <stats/> reply.
+*	@param 	port is the server's port.
+*			*name is the name of the counter.
+*	@return returns the counter, or -1 if it could not be read.
+*/
+long readStat(int port, char *name);
+
+/**	@brief 	Files in the root directory are sent whole, large ones too, and again once they
+*			change; names outside the root, hidden files, missing files, seqpacket clients
+*			and servers without a root get an error.
+*	@param 	port is a free port for the servers the test starts.
+*	@return returns nothing.
+*/
+void testFiles(int port);
+
+/**	@brief 	A proxy forwards pipelined requests to its backends and puts the replies back in
+*			order, file replies included; it fails over when a backend dies and answers with
+*			an error when none is left.
+*	@param 	port is a free port for the proxy; the two ports after it are used by the backends.
+*	@return returns nothing.
+*/
+void testProxy(int port);
+
+
+/**	@brief 	The main program for the loopback tests.
+*	@param 	-s <server program> is the server to test, ./server by default.
+*	@return returns 0 to the OS if every check passed, 1 otherwise.
+*/
+int main(int argc, char**argv)
+{
+	char *noOptions[] = { NULL }, command[TEST_PATH_MAX + 16];
+	pid_t server = -1;
+	int option = 0;
+
+	while((option = getopt(argc, argv, "s:r:")) != -1)
+	{
+		switch(option)
+		{
+			case 's': serverProgram = optarg; break;
+			case 'r': replayProgram = optarg; break;
+			default:
+				fprintf(stderr, "./loopback_test [-s <Server Program>] [-r <Replay Program>]\n");
+				return 1;
+		}
+	}
+	//a server that goes away mid test must fail the checks, not kill the tests
+	signal(SIGPIPE, SIG_IGN);
+	if(mkdtemp(testDirectory) == NULL)
+	{
+		fprintf(stderr, "ERROR: Cannot Create the Test Directory\n");
+		return 1;
+	}
+
+	server = startServer(TEST_PORT, noOptions);
+	if(!expect(server != -1, "server", "starts"))
+		return 1;
+	testPipelining(TEST_PORT);
+	testAsyncClient(TEST_PORT, TEST_PORT + 2);
+	expect(stopServer(server) == 0, "server", "exits normally on SIGTERM");
+	testCapture(TEST_PORT + 1);
+	testLocalSockets(TEST_PORT + 3);
+	testWorkers(TEST_PORT + 4);
+	testFiles(TEST_PORT + 5);
+	testProxy(TEST_PORT + 6);
+
+	snprintf(command, sizeof(command), "rm -rf %s", testDirectory);
+	system(command);
+	printf("%d of %d checks failed\n", failures, checks);
+	return failures > 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+pid_t startServer(int port, char **options){
+  char *arguments[TEST_MAX_OPTIONS + 5], portText[16], response[MAX_MESSAGE];
+  TestConnection_T probe;
+  uint64_t start = 0;
+  int null = -1, status = 0, count = 0, i = 0;
+  pid_t server = -1;
+
+  sprintf(portText, "%d", port);
+  arguments[count++] = serverProgram;
+  arguments[count++] = "-q";
+  arguments[count++] = "-p";
+  arguments[count++] = portText;
+  for(i = 0; options[i] != NULL && i < TEST_MAX_OPTIONS; i++) arguments[count++] = options[i];
+  arguments[count] = NULL;
+
+  server = fork();
+  if(server == -1) return -1;
+  if(server == 0)
+  {
+	//a test that crashes takes its servers with it
+	prctl(PR_SET_PDEATHSIG, SIGTERM);
+	null = open("/dev/null", O_WRONLY);
+	if(null != -1)
+	{
+		dup2(null, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+	}
+	execv(serverProgram, arguments);
+	_exit(127);
+  }
+
+  //the server is up once it answers a request, not just once it listens
+  for(start = testClock(); testClock() - start < TEST_START_MS * NANOSECONDS_PER_MS; usleep(20000))
+  {
+	if(waitpid(server, &status, WNOHANG) == server) return -1;
+	if(openConnection(&probe, port) == -1) continue;
+	status = (sendAll(&probe, "<loadavg/>\n") == 0 && readResponse(&probe, response, sizeof(response), TEST_TIMEOUT_MS) > 0);
+	close(probe.sock);
+	if(status) return server;
+  }
+  kill(server, SIGKILL);
+  waitpid(server, NULL, 0);
+  return -1;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int stopServer(pid_t server){
+  int status = 0;
+  kill(server, SIGTERM);
+  if(waitpid(server, &status, 0) != server || !WIFEXITED(status)) return -1;
+  return WEXITSTATUS(status);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int openConnection(TestConnection_P connection, int port){
+  struct sockaddr_in address;
+  int noDelay = 1;
+  memset((void *) &address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons((u_short) port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  connection->length = 0;
+  connection->sock = socket(AF_INET, SOCK_STREAM, 0);
+  if(connection->sock == -1) return -1;
+  //requests split across sends must not sit behind Nagle for longer than the server waits for them
+  setsockopt(connection->sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  if(connect(connection->sock, (struct sockaddr *) &address, sizeof(address)) == -1)
+  {
+	close(connection->sock);
+	return -1;
+  }
+  return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int sendAll(TestConnection_P connection, char *request){
+  int length = strlen(request), sent = 0, byteSentCount = 0;
+  while(sent < length)
+  {
+	byteSentCount = send(connection->sock, request + sent, length - sent, MSG_NOSIGNAL);
+	if(byteSentCount <= 0) return -1;
+	sent += byteSentCount;
+  }
+  return 0;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int readResponse(TestConnection_P connection, char *response, int capacity, int timeoutMs){
+  struct pollfd ready;
+  uint64_t deadline = testClock() + timeoutMs * NANOSECONDS_PER_MS, now = 0;
+  int length = 0, byteReceivedCount = 0;
+  ready.fd = connection->sock;
+  ready.events = POLLIN;
+  while((length = responseLength(connection->buffer, connection->length)) == 0)
+  {
+	now = testClock();
+	if(now >= deadline || connection->length == TEST_BUFFER) return -1;
+	if(poll(&ready, 1, (int) ((deadline - now) / NANOSECONDS_PER_MS) + 1) <= 0) continue;
+	byteReceivedCount = recv(connection->sock, connection->buffer + connection->length, TEST_BUFFER - connection->length, 0);
+	if(byteReceivedCount <= 0) return -1;
+	connection->length += byteReceivedCount;
+  }
+  if(length >= capacity) return -1;
+  memcpy(response, connection->buffer, length);
+  response[length] = '\0';
+  connection->length -= length;
+  memmove(connection->buffer, connection->buffer + length, connection->length);
+  return length;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int readPacket(int sock, char *packet, int capacity, int timeoutMs){
+  struct pollfd ready;
+  int length = 0;
+  ready.fd = sock;
+  ready.events = POLLIN;
+  if(poll(&ready, 1, timeoutMs) <= 0) return -1;
+  length = recv(sock, packet, capacity - 1, MSG_DONTWAIT);
+  if(length <= 0) return -1;
+  packet[length] = '\0';
+  return length;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int expect(int passed, char *test, char *what){
+  checks++;
+  if(!passed) failures++;
+  printf("%s %s: %s\n", passed ? "PASS" : "FAIL", test, what);
+  return passed;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int expectResponse(TestConnection_P connection, char *test, char *expected, int prefix){
+  char response[TEST_BUFFER], what[MAX_MESSAGE * 2];
+  int length = readResponse(connection, response, sizeof(response), TEST_TIMEOUT_MS);
+  int passed = (length > 0) && (prefix ? !strncmp(response, expected, strlen(expected)) : !strcmp(response, expected));
+  int shown = (length > 0) ? strcspn(response, "\n") : 0;	//only the first line of a long response is printed
+  if(shown > 120) shown = 120;
+  if(length <= 0) snprintf(what, sizeof(what), "expected %s, got nothing", expected);
+  else if(passed) snprintf(what, sizeof(what), "got %.*s", shown, response);
+  else snprintf(what, sizeof(what), "expected %s, got %.*s", expected, shown, response);
+  return expect(passed, test, what);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int listenLoopback(int port){
+  struct sockaddr_in address;
+  int listener = socket(AF_INET, SOCK_STREAM, 0), reuse = 1;
+  if(listener == -1) return -1;
+  memset((void *) &address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons((u_short) port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if(bind(listener, (struct sockaddr *) &address, sizeof(address)) == -1 || listen(listener, 4) == -1)
+  {
+	close(listener);
+	return -1;
+  }
+  return listener;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void recordCallback(void * context, int id, int status, char * response){
+  TestCallbacks_P callbacks = (TestCallbacks_P) context;
+  callbacks->calls++;
+  callbacks->status = status;
+  snprintf(callbacks->response, sizeof(callbacks->response), "%s", (response != NULL) ? response : "");
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int runProgram(char *command, char *output, int capacity){
+  char line[TEST_PATH_MAX + 32];
+  int length = 0, status = 0;
+  FILE *program = NULL;
+  snprintf(line, sizeof(line), "%s 2>&1", command);
+  program = popen(line, "r");
+  if(program == NULL) return -1;
+  length = fread(output, 1, capacity - 1, program);
+  output[length] = '\0';
+  status = pclose(program);
+  if(status == -1 || !WIFEXITED(status)) return -1;
+  return WEXITSTATUS(status);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+int writeTestFile(char *name, char *data, int length){
+  char path[TEST_PATH_MAX];
+  FILE *file = fopen(testPath(name, path), "w");
+  if(file == NULL) return -1;
+  if(fwrite(data, 1, length, file) != length)
+  {
+	fclose(file);
+	return -1;
+  }
+  return fclose(file);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+char *testPath(char *name, char *path){
+  snprintf(path, TEST_PATH_MAX, "%s/%s", testDirectory, name);
+  return path;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+uint64_t testClock(void){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000 * NANOSECONDS_PER_MS + now.tv_nsec;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void testPipelining(int port){
+  TestConnection_T connection;
+  struct sockaddr_in dest;
+  char oversized[OVERSIZED_REQUEST + 32], echoed[MAX_MESSAGE], request[MAX_MESSAGE * 2], expected[MAX_MESSAGE * 2], reply[MAX_RESPONSE];
+  int sockfd = -1;
+  uint64_t start = 0;
+  if(!expect(openConnection(&connection, port) == 0, "pipelining", "connects")) return;
+
+  //every request in one write; a closing tag inside an echo must not split its reply
+  sendAll(&connection, "<echo>a</reply>b</echo>\n<echo>second</echo>\n<loadavg/>\n<echo>x&y</echo><stats/>\n<hello>World</hello>\n");
+  expectResponse(&connection, "pipelining", "<reply>a&lt;/reply>b</reply>", 0);
+  expectResponse(&connection, "pipelining", "<reply>second</reply>", 0);
+  expectResponse(&connection, "pipelining", "<replyLoadAvg>", 1);
+  expectResponse(&connection, "pipelining", "<reply>x&amp;y</reply>", 0);
+  expectResponse(&connection, "pipelining", "<replyStats>", 1);
+  expectResponse(&connection, "pipelining", "<error>unknown format</error>", 0);
+
+  //a request split across sends by a pipelining client is put back together
+  sendAll(&connection, "<echo>split ");
+  usleep(5000);
+  sendAll(&connection, "request</echo>\n");
+  expectResponse(&connection, "pipelining", "<reply>split request</reply>", 0);
+
+  //a request longer than the server's buffer gets one error, and the request after it is answered
+  memset(oversized, 'a', sizeof(oversized));
+  memcpy(oversized, "<echo>", strlen("<echo>"));
+  strcpy(oversized + OVERSIZED_REQUEST - strlen("</echo>\n"), "</echo>\n<loadavg/>\n");
+  sendAll(&connection, oversized);
+  expectResponse(&connection, "oversized", "<error>request too long</error>", 0);
+  expectResponse(&connection, "oversized", "<replyLoadAvg>", 1);
+  //also when its end comes in a later send, cut in the middle of the </echo>
+  oversized[OVERSIZED_REQUEST - strlen("</echo>\n") + strlen("</e")] = '\0';
+  sendAll(&connection, oversized);
+  usleep(5000);
+  sendAll(&connection, "cho>\n<echo>after</echo>\n");
+  expectResponse(&connection, "oversized", "<error>request too long</error>", 0);
+  expectResponse(&connection, "oversized", "<reply>after</reply>", 0);
+  //and when it is not an <echo>, up to its newline
+  memset(oversized, 'b', OVERSIZED_REQUEST);
+  strcpy(oversized + OVERSIZED_REQUEST, "\n<stats/>\n");
+  sendAll(&connection, oversized);
+  expectResponse(&connection, "oversized", "<error>request too long</error>", 0);
+  expectResponse(&connection, "oversized", "<replyStats>", 1);
+  close(connection.sock);
+
+  //a client that does not pipeline is not kept waiting for the rest of an unclosed request
+  if(!expect(openConnection(&connection, port) == 0, "unterminated", "connects")) return;
+  start = testClock();
+  sendAll(&connection, "<echo> Hello World <echo>");
+  expectResponse(&connection, "unterminated", "<error>unknown format</error>", 0);
+  expect(testClock() - start < REQUEST_WAIT_MS * NANOSECONDS_PER_MS, "unterminated", "answered without waiting REQUEST_WAIT_MS");
+  close(connection.sock);
+
+  //the blocking client reads the whole escaped reply, however long, and gets back what it sent
+  strcpy(echoed, "a</reply>&amp;");
+  memset(echoed + strlen(echoed), '&', TEST_ESCAPED);
+  echoed[strlen("a</reply>&amp;") + TEST_ESCAPED] = '\0';
+  sprintf(request, "<echo>%s</echo>\n", echoed);
+  sprintf(expected, "<reply>%s</reply>", echoed);
+  sockfd = createSocket("127.0.0.1", port, &dest);
+  if(!expect(sockfd >= 0, "unescape", "connects")) return;
+  expect(sendRequest(sockfd, request, &dest) == 0 && receiveResponse(sockfd, reply) == 0 && !strcmp(reply, expected), "unescape", "echoed text comes back as it was sent");
+  closeSocket(sockfd);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void testCapture(int port){
+  char capture[TEST_PATH_MAX], damaged[TEST_PATH_MAX], root[TEST_PATH_MAX], command[TEST_PATH_MAX * 3], output[TEST_BUFFER];
+  char file[TEST_FILE_SIZE], *data = NULL;
+  char *captureOptions[] = { "-c", capture, "-f", root, NULL }, *fileOptions[] = { "-f", root, NULL };
+  CaptureRecord_T record;
+  TestConnection_T connection;
+  struct timeval wait = { TEST_TIMEOUT_MS / 1000, 0 };
+  FILE *reader = NULL, *replay = NULL;
+  pid_t server = -1;
+  int records = 0, result = 0, listener = -1, fake = -1, i = 0;
+
+  //a file larger than any single receive, holding closing tags of its own
+  for(i = 0; i < TEST_FILE_SIZE; i++) file[i] = "</reply>\n"[i % 9];
+  testPath("capture", capture);
+  testPath("files", root);
+  mkdir(root, 0700);
+  if(!expect(writeTestFile("files/big.txt", file, TEST_FILE_SIZE) == 0, "capture", "writes the test file")) return;
+
+  server = startServer(port, captureOptions);
+  if(!expect(server != -1, "capture", "server starts with a capture file")) return;
+  if(expect(openConnection(&connection, port) == 0, "capture", "connects"))
+  {
+	sendAll(&connection, "<echo>captured</echo>\n<get-file>big.txt</get-file>\n<loadavg/>\n");
+	expectResponse(&connection, "capture", "<reply>captured</reply>", 0);
+	expectResponse(&connection, "capture", "<replyFile length=\"3000\">", 1);
+	expectResponse(&connection, "capture", "<replyLoadAvg>", 1);
+	close(connection.sock);
+  }
+  //the last requests are still in memory until the server stops
+  expect(stopServer(server) == 0, "capture", "server exits normally on SIGTERM");
+  reader = open_Capture_Reader(capture);
+  if(!expect(reader != NULL, "capture", "capture file is readable")) return;
+  while((result = read_Capture_Record(reader, &record)) == 1)
+  {
+	records++;
+	free(record.request);
+  }
+  fclose(reader);
+  //the start up probe is captured too
+  expect(result == 0 && records == 4, "capture", "every request was written at exit");
+
+  //the replay pairs every reply with its own request, the file reply included
+  server = startServer(port, fileOptions);
+  if(!expect(server != -1, "replay", "server starts")) return;
+  snprintf(command, sizeof(command), "%s 127.0.0.1 %d %s 0", replayProgram, port, capture);
+  result = runProgram(command, output, sizeof(output));
+  expect(result == 0 && strstr(output, "Replayed 4 requests") != NULL && strstr(output, ", 0 failed") != NULL, "replay", "replays every captured request");
+
+  //a capture cut off in the middle of a record replays the requests before it
+  reader = fopen(capture, "r");
+  data = (char *) malloc(TEST_BUFFER);
+  if(reader != NULL && data != NULL)
+  {
+	result = fread(data, 1, TEST_BUFFER, reader);
+	writeTestFile("damaged", data, result - 3);
+	snprintf(command, sizeof(command), "%s 127.0.0.1 %d %s 0", replayProgram, port, testPath("damaged", damaged));
+	result = runProgram(command, output, sizeof(output));
+	expect(result == 0 && strstr(output, "Capture File Is Damaged, Replaying the First 3 Requests") != NULL, "replay", "damaged capture replays the whole records");
+  }
+  if(reader != NULL) fclose(reader);
+  free(data);
+
+  //a file that is not a capture is refused
+  snprintf(command, sizeof(command), "%s 127.0.0.1 %d %s 0", replayProgram, port, testPath("files/big.txt", damaged));
+  result = runProgram(command, output, sizeof(output));
+  expect(result != 0 && strstr(output, "Is Not a Capture File") != NULL, "replay", "refuses a file that is not a capture");
+  expect(stopServer(server) == 0, "replay", "server exits normally on SIGTERM");
+
+  //a request is sent at its recorded time even while the reply to the one before it is late
+  if(!expect(open_Capture(testPath("paced", capture)) == 0, "paced", "capture opens")) return;
+  record_Capture(1, "<echo>first</echo>\n", strlen("<echo>first</echo>\n"));
+  usleep(TEST_REPLAY_GAP_MS * 1000);
+  record_Capture(1, "<echo>second</echo>\n", strlen("<echo>second</echo>\n"));
+  close_Capture();
+  listener = listenLoopback(port);
+  if(!expect(listener != -1, "paced", "fake server listens")) return;
+  snprintf(command, sizeof(command), "%s 127.0.0.1 %d %s 1 2>&1", replayProgram, port, capture);
+  replay = popen(command, "r");
+  fake = (replay != NULL) ? accept(listener, NULL, NULL) : -1;
+  if(expect(fake != -1, "paced", "replay connects"))
+  {
+	//the fake server answers nothing until both requests are in
+	setsockopt(fake, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
+	for(result = 0; strstr(output, "<echo>second</echo>") == NULL && (i = recv(fake, output + result, sizeof(output) - 1 - result, 0)) > 0; )
+		output[result += i] = '\0';
+	expect(strstr(output, "<echo>second</echo>") != NULL, "paced", "second request is sent before the first is answered");
+	send(fake, "<reply>first</reply><reply>second</reply>", strlen("<reply>first</reply><reply>second</reply>"), MSG_NOSIGNAL);
+	close(fake);
+  }
+  close(listener);
+  if(replay != NULL)
+  {
+	result = fread(output, 1, sizeof(output) - 1, replay);
+	output[result] = '\0';
+	pclose(replay);
+	expect(strstr(output, "Replayed 2 requests") != NULL && strstr(output, ", 0 failed") != NULL, "paced", "both replies are matched to their requests");
+  }
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void testAsyncClient(int port, int fakePort){
+  char expected[TEST_ASYNC_REQUESTS][MAX_MESSAGE], request[MAX_MESSAGE], received[MAX_MESSAGE];
+  int ids[TEST_ASYNC_REQUESTS], server = 0, matched = 0, collected = 0, listener = -1, fake = -1, i = 0, j = 0;
+  TestCallbacks_T callbacks;
+  AsyncResponse_T response;
+  AsyncClient_P client = createAsyncClient();
+  if(!expect(client != NULL, "async", "client is created")) return;
+
+  //requests spread over two connections come back in the order they were queued on each
+  server = addAsyncServer(client, "127.0.0.1", port, 2);
+  expect(server >= 0, "async", "server is added");
+  for(i = 0; i < TEST_ASYNC_REQUESTS; i++)
+  {
+	sprintf(request, "<echo>async %d</reply>&amp;</echo>", i);
+	sprintf(expected[i], "<reply>async %d</reply>&amp;</reply>", i);
+	ids[i] = sendAsyncRequest(client, server, request, NULL, NULL);
+  }
+  expect(waitAsyncClient(client) == 0, "async", "every request is answered");
+  while(nextAsyncResponse(client, &response) == 1)
+  {
+	collected++;
+	for(j = 0; j < TEST_ASYNC_REQUESTS; j++)
+		if(ids[j] == response.id && response.status == 0 && response.response != NULL && !strcmp(response.response, expected[j])) matched++;
+	free(response.response);
+  }
+  expect(collected == TEST_ASYNC_REQUESTS && matched == TEST_ASYNC_REQUESTS, "async", "every response is paired with its own request");
+
+  //a request the server would refuse is not queued; the newline it gets counts towards its length
+  memset(request, 'a', MAX_MESSAGE - 1);
+  request[MAX_MESSAGE - 1] = '\0';
+  expect(sendAsyncRequest(client, server, request, NULL, NULL) < 0 && pendingAsyncRequests(client) == 0, "async", "a request too long for the server is refused");
+  request[MAX_MESSAGE - 2] = '\0';
+  expect(sendAsyncRequest(client, server, request, NULL, NULL) >= 0 && waitAsyncClient(client) == 0, "async", "the longest request is sent");
+  while(nextAsyncResponse(client, &response) == 1) free(response.response);
+
+  //a server that answers before it was asked
+  listener = listenLoopback(fakePort);
+  if(!expect(listener != -1, "async", "fake server listens")) return;
+  server = addAsyncServer(client, "127.0.0.1", fakePort, 1);
+  fake = accept(listener, NULL, NULL);
+  if(expect(server >= 0 && fake != -1, "async", "connects to the fake server"))
+  {
+	send(fake, "<reply>unsolicited</reply>", strlen("<reply>unsolicited</reply>"), MSG_NOSIGNAL);
+	for(i = 0; i < TEST_POLLS && recv(fake, received, sizeof(received), MSG_DONTWAIT) != 0; i++)
+		pollAsyncClient(client, 10);
+	expect(i < TEST_POLLS, "async", "a response to nothing closes the connection");
+	expect(pendingAsyncRequests(client) == 0 && nextAsyncResponse(client, &response) == 0, "async", "a response to nothing is not delivered");
+	close(fake);
+  }
+
+  //a server that answers one request twice
+  memset((void *) &callbacks, 0, sizeof(callbacks));
+  sendAsyncRequest(client, server, "<echo>once</echo>", recordCallback, &callbacks);
+  fake = accept(listener, NULL, NULL);
+  if(expect(fake != -1, "async", "reconnects to the fake server"))
+  {
+	for(i = 0; i < TEST_POLLS && recv(fake, received, sizeof(received), MSG_DONTWAIT) <= 0; i++)
+		pollAsyncClient(client, 10);
+	send(fake, "<reply>once</reply><reply>twice</reply>", strlen("<reply>once</reply><reply>twice</reply>"), MSG_NOSIGNAL);
+	for(i = 0; i < TEST_POLLS && recv(fake, received, sizeof(received), MSG_DONTWAIT) != 0; i++)
+		pollAsyncClient(client, 10);
+	expect(callbacks.calls == 1 && callbacks.status == 0 && !strcmp(callbacks.response, "<reply>once</reply>"), "async", "the request gets its own response only");
+	expect(i < TEST_POLLS && pendingAsyncRequests(client) == 0, "async", "the extra response closes the connection");
+	close(fake);
+  }
+  close(listener);
+  closeAsyncClient(client);
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void testLocalSockets(int port){
+  char path[TEST_PATH_MAX], address[TEST_PATH_MAX + 16], command[TEST_PATH_MAX * 2], output[TEST_BUFFER], packet[TEST_BUFFER];
+  char *streamOptions[] = { "-u", path, NULL }, *seqpacketOptions[] = { "-u", path, "-s", NULL };
+  struct sockaddr_in dest;
+  TestConnection_T connection;
+  pid_t server = -1;
+  int result = 0;
+
+  //a stream socket takes pipelined requests like TCP does
+  testPath("local.sock", path);
+  server = startServer(port, streamOptions);
+  if(expect(server != -1, "local", "server starts with a stream socket"))
+  {
+	snprintf(address, sizeof(address), "%s%s", LOCAL_PREFIX, path);
+	connection.sock = createSocket(address, 0, &dest);
+	connection.length = 0;
+	if(expect(connection.sock >= 0, "local", "connects to the stream socket"))
+	{
+		sendAll(&connection, "<echo>local</echo>\n<loadavg/>\n");
+		expectResponse(&connection, "local", "<reply>local</reply>", 0);
+		expectResponse(&connection, "local", "<replyLoadAvg>", 1);
+		close(connection.sock);
+	}
+	expect(stopServer(server) == 0, "local", "server exits normally on SIGTERM");
+  }
+
+  //on a seqpacket socket every request is a packet and so is its reply
+  server = startServer(port, seqpacketOptions);
+  if(expect(server != -1, "seqpacket", "server starts with a seqpacket socket"))
+  {
+	snprintf(address, sizeof(address), "%s%s", SEQPACKET_PREFIX, path);
+	connection.sock = createSocket(address, 0, &dest);
+	if(expect(connection.sock >= 0, "seqpacket", "connects to the seqpacket socket"))
+	{
+		send(connection.sock, "<echo>packet</echo>", 19, MSG_NOSIGNAL);
+		result = readPacket(connection.sock, packet, sizeof(packet), TEST_TIMEOUT_MS);
+		expect(result > 0 && !strcmp(packet, "<reply>packet</reply>"), "seqpacket", "an echo is answered in one packet");
+		send(connection.sock, "<hello/>", 8, MSG_NOSIGNAL);
+		result = readPacket(connection.sock, packet, sizeof(packet), TEST_TIMEOUT_MS);
+		expect(result > 0 && !strcmp(packet, "<error>unknown format</error>"), "seqpacket", "an unknown request is answered with an error");
+		close(connection.sock);
+	}
+	expect(stopServer(server) == 0, "seqpacket", "server exits normally on SIGTERM");
+  }
+
+  //the client does not connect to a path with no server, and the server does not start on a path it cannot bind
+  snprintf(address, sizeof(address), "%s%s", LOCAL_PREFIX, path);
+  unlink(path);
+  result = createSocket(address, 0, &dest);
+  expect(result < 0, "local", "connecting to a path with no server fails");
+  if(result >= 0) close(result);
+  snprintf(command, sizeof(command), "%s -q -p %d -u %s", serverProgram, port, testPath("missing/local.sock", path));
+  result = runProgram(command, output, sizeof(output));
+  expect(result == 1 && strstr(output, "Failed to Bind To Local Socket") != NULL, "local", "server stops on a path it cannot bind");
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+long readStat(int port, char *name){
+  char response[MAX_MESSAGE], *counter = NULL;
+  TestConnection_T connection;
+  long value = -1;
+  if(openConnection(&connection, port) == -1) return -1;
+  if(sendAll(&connection, "<stats/>\n") == 0 && readResponse(&connection, response, sizeof(response), TEST_TIMEOUT_MS) > 0
+	&& (counter = strstr(response, name)) != NULL && counter[strlen(name)] == '=')
+	value = strtol(counter + strlen(name) + 1, NULL, 10);
+  close(connection.sock);
+  return value;
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void testWorkers(int port){
+  char path[TEST_PATH_MAX], address[TEST_PATH_MAX + 16], packet[TEST_BUFFER], requests[TEST_PACKETS][MAX_MESSAGE], expected[MAX_RESPONSE];
+  char *seqpacketOptions[] = { "-u", path, "-s", NULL }, *rateOptions[] = { "-r", "20:1", NULL }, *budgetOptions[] = { "-w", "1", "-b", "2", NULL };
+  char *drainOptions[] = { "-w", "1", "-b", "1000", "-u", path, NULL }, echoed[MAX_MESSAGE], request[MAX_MESSAGE * 2], reply[MAX_RESPONSE * 2], *pipelined = NULL;
+  struct mmsghdr packets[TEST_PACKETS];
+  struct iovec parts[TEST_PACKETS];
+  struct sockaddr_in dest;
+  TestConnection_T connection;
+  uint64_t start = 0;
+  pid_t server = -1;
+  int replies = 0, i = 0;
+
+  //pipelined packets are answered in as many packets, even when the worker takes them in one round
+  testPath("workers.sock", path);
+  server = startServer(port, seqpacketOptions);
+  if(expect(server != -1, "seqpacket", "server starts with a seqpacket socket"))
+  {
+	snprintf(address, sizeof(address), "%s%s", SEQPACKET_PREFIX, path);
+	connection.sock = createSocket(address, 0, &dest);
+	if(expect(connection.sock >= 0, "seqpacket", "connects to the seqpacket socket"))
+	{
+		//one call queues every packet before the worker wakes up for the first
+		for(i = 0; i < TEST_PACKETS; i++)
+		{
+			sprintf(requests[i], "<echo>packet %d</echo>", i);
+			parts[i].iov_base = requests[i];
+			parts[i].iov_len = strlen(requests[i]);
+			memset((void *) &packets[i], 0, sizeof(struct mmsghdr));
+			packets[i].msg_hdr.msg_iov = &parts[i];
+			packets[i].msg_hdr.msg_iovlen = 1;
+		}
+		sendmmsg(connection.sock, packets, TEST_PACKETS, MSG_NOSIGNAL);
+		for(i = 0; i < TEST_PACKETS; i++)
+		{
+			sprintf(expected, "<reply>packet %d</reply>", i);
+			if(readPacket(connection.sock, packet, sizeof(packet), TEST_TIMEOUT_MS) > 0 && !strcmp(packet, expected)) replies++;
+		}
+		expect(replies == TEST_PACKETS, "seqpacket", "pipelined requests get one packet per reply");
+		close(connection.sock);
+	}
+	expect(stopServer(server) == 0, "seqpacket", "server exits normally on SIGTERM");
+  }
+
+  //at 20 requests a second with no burst, five requests take at least 200ms
+  server = startServer(port, rateOptions);
+  if(expect(server != -1, "rate", "server starts with a rate limit"))
+  {
+	//the probe that found the server up took the one request of the burst
+	usleep(100000);
+	if(expect(openConnection(&connection, port) == 0, "rate", "connects"))
+	{
+		start = testClock();
+		sendAll(&connection, "<echo>1</echo>\n<echo>2</echo>\n<echo>3</echo>\n<echo>4</echo>\n<echo>5</echo>\n");
+		for(i = 1, replies = 0; i <= 5; i++)
+		{
+			sprintf(expected, "<reply>%d</reply>", i);
+			if(readResponse(&connection, packet, sizeof(packet), TEST_TIMEOUT_MS) > 0 && !strcmp(packet, expected)) replies++;
+		}
+		expect(replies == 5, "rate", "every request is answered in order");
+		expect(testClock() - start >= 150 * NANOSECONDS_PER_MS, "rate", "requests over the limit are slowed down");
+		close(connection.sock);
+	}
+	expect(readStat(port, "rateLimited") > 0, "rate", "waits for the limit are counted");
+	expect(stopServer(server) == 0, "rate", "server exits normally on SIGTERM");
+  }
+
+  //a client with more requests than its budget has to make way after every two
+  server = startServer(port, budgetOptions);
+  if(expect(server != -1, "budget", "server starts with a budget of 2"))
+  {
+	if(expect(openConnection(&connection, port) == 0, "budget", "connects"))
+	{
+		sendAll(&connection, "<echo>a</echo>\n<echo>b</echo>\n<echo>c</echo>\n<echo>d</echo>\n<echo>e</echo>\n<echo>f</echo>\n");
+		for(i = 0, replies = 0; i < 6; i++)
+		{
+			sprintf(expected, "<reply>%c</reply>", 'a' + i);
+			if(readResponse(&connection, packet, sizeof(packet), TEST_TIMEOUT_MS) > 0 && !strcmp(packet, expected)) replies++;
+		}
+		expect(replies == 6, "budget", "every request is answered in order");
+		close(connection.sock);
+	}
+	expect(readStat(port, "budgetYields") >= 2, "budget", "rounds that used the whole budget are counted");
+	expect(stopServer(server) == 0, "budget", "server exits normally on SIGTERM");
+  }
+
+  //a client that stops sending before it reads gets every reply, even those the socket had no room for
+  server = startServer(port, drainOptions);
+  if(expect(server != -1, "drain", "server starts with a budget of 1000"))
+  {
+	memset(echoed, '&', TEST_DRAIN_ECHO);
+	echoed[TEST_DRAIN_ECHO] = '\0';
+	for(i = 0, expected[0] = '\0'; i < TEST_DRAIN_ECHO; i++) strcat(expected, "&amp;");
+	sprintf(request, "<echo>%s</echo>\n", echoed);
+	sprintf(reply, "<reply>%s</reply>", expected);
+	//a local stream socket buffers a fixed amount, less than the replies of one round
+	snprintf(address, sizeof(address), "%s%s", LOCAL_PREFIX, path);
+	connection.length = 0;
+	connection.sock = createSocket(address, 0, &dest);
+	if(expect(connection.sock >= 0, "drain", "connects"))
+	{
+		//the server is stopped meanwhile, so its worker finds every request and the end of the stream in one round
+		kill(server, SIGSTOP);
+		pipelined = (char *) malloc(TEST_DRAIN_REQUESTS * strlen(request) + 1);
+		for(i = 0, replies = 0; pipelined != NULL && i < TEST_DRAIN_REQUESTS; i++) strcpy(pipelined + i * strlen(request), request);
+		if(pipelined != NULL) sendAll(&connection, pipelined);
+		free(pipelined);
+		shutdown(connection.sock, SHUT_WR);
+		kill(server, SIGCONT);
+		usleep(100000);
+		for(i = 0; i < TEST_DRAIN_REQUESTS; i++)
+			if(readResponse(&connection, packet, sizeof(packet), TEST_TIMEOUT_MS) > 0 && !strcmp(packet, reply)) replies++;
+		expect(replies == TEST_DRAIN_REQUESTS, "drain", "every reply arrives after the client stopped sending");
+		expect(readResponse(&connection, packet, sizeof(packet), TEST_TIMEOUT_MS) == -1, "drain", "the server closes the connection once the replies are out");
+		close(connection.sock);
+	}
+	expect(stopServer(server) == 0, "drain", "server exits normally on SIGTERM");
+  }
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void testFiles(int port){
+  char root[TEST_PATH_MAX], path[TEST_PATH_MAX], address[TEST_PATH_MAX + 16], packet[TEST_BUFFER], *large = NULL, *contents = NULL;
+  char timeout[16], response[TEST_BUFFER];
+  char *fileOptions[] = { "-f", root, "-u", path, "-s", NULL }, *noOptions[] = { NULL };
+  char *stallOptions[] = { "-w", "1", "-f", root, "-u", path, "-t", timeout, NULL };
+  struct sockaddr_in dest;
+  TestConnection_T connection;
+  pid_t server = -1;
+  long length = 0;
+  int sock = -1, result = 0, i = 0, received = 0;
+
+  testPath("root", root);
+  testPath("files.sock", path);
+  mkdir(root, 0700);
+  large = (char *) malloc(TEST_LARGE_FILE);
+  if(!expect(large != NULL, "file", "allocates the large file")) return;
+  for(i = 0; i < TEST_LARGE_FILE; i++) large[i] = (char) (i * 7 + i / 4096);
+  writeTestFile("root/hello.txt", "hello", 5);
+  writeTestFile("root/large.bin", large, TEST_LARGE_FILE);
+  writeTestFile("root/.hidden", "hidden", 6);
+  writeTestFile("secret.txt", "secret", 6);
+
+  server = startServer(port, fileOptions);
+  if(expect(server != -1, "file", "server starts with a file root"))
+  {
+	sock = createSocket("127.0.0.1", port, &dest);
+	if(expect(sock >= 0, "file", "connects"))
+	{
+		result = requestFile(sock, "hello.txt", &contents, &length);
+		expect(result == 0 && length == 5 && !memcmp(contents, "hello", 5), "file", "a small file is sent whole");
+		free(contents);
+		//larger than the socket takes at once, so the sending task has to wait for the client
+		result = requestFile(sock, "large.bin", &contents, &length);
+		expect(result == 0 && length == TEST_LARGE_FILE && !memcmp(contents, large, TEST_LARGE_FILE), "file", "a large file is sent whole");
+		free(contents);
+		//a changed file is not served from the old mapping
+		writeTestFile("root/hello.txt", "changed", 7);
+		for(i = 0; i < TEST_POLLS; i++, usleep(20000))
+		{
+			contents = NULL;
+			result = requestFile(sock, "hello.txt", &contents, &length);
+			if(result == 0 && length == 7 && !memcmp(contents, "changed", 7)) break;
+			free(contents);
+		}
+		expect(i < TEST_POLLS, "file", "a changed file is sent as it is now");
+		if(i < TEST_POLLS) free(contents);
+		expect(requestFile(sock, "missing.txt", &contents, &length) == -2, "file", "a missing file is an error");
+		close(sock);
+	}
+
+	//nothing outside the root directory and nothing hidden is served
+	if(expect(openConnection(&connection, port) == 0, "file", "connects"))
+	{
+		sendAll(&connection, "<get-file>../secret.txt</get-file>\n<get-file>.hidden</get-file>\n<get-file></get-file>\n<get-file>missing.txt</get-file>\n<get-file>hello.txt\n");
+		expectResponse(&connection, "file", "<error>file not found</error>", 0);
+		expectResponse(&connection, "file", "<error>file not found</error>", 0);
+		expectResponse(&connection, "file", "<error>file not found</error>", 0);
+		expectResponse(&connection, "file", "<error>file not found</error>", 0);
+		expectResponse(&connection, "file", "<error>unknown format</error>", 0);
+		close(connection.sock);
+	}
+
+	//a file does not fit into a packet
+	snprintf(address, sizeof(address), "%s%s", SEQPACKET_PREFIX, path);
+	sock = createSocket(address, 0, &dest);
+	if(expect(sock >= 0, "file", "connects to the seqpacket socket"))
+	{
+		send(sock, "<get-file>hello.txt</get-file>", 30, MSG_NOSIGNAL);
+		result = readPacket(sock, packet, sizeof(packet), TEST_TIMEOUT_MS);
+		expect(result > 0 && !strcmp(packet, "<error>file needs a stream connection</error>"), "file", "a seqpacket client is refused files");
+		close(sock);
+	}
+	expect(stopServer(server) == 0, "file", "server exits normally on SIGTERM");
+  }
+
+  //a client that stops reading a file leaves its task waiting, but not the worker it shares
+  snprintf(timeout, sizeof(timeout), "%d", TEST_SEND_TIMEOUT_MS);
+  server = startServer(port, stallOptions);
+  if(expect(server != -1, "file", "server starts with one worker and a send timeout"))
+  {
+	//a local stream socket takes far less than the large file before it is full
+	sock = createSocket(path, 0, &dest);
+	if(expect(sock >= 0, "file", "connects to the local socket"))
+	{
+		send(sock, "<get-file>large.bin</get-file>\n", 31, MSG_NOSIGNAL);
+		usleep(100000);
+		if(expect(openConnection(&connection, port) == 0, "file", "connects while the file waits"))
+		{
+			sendAll(&connection, "<echo>beside</echo>\n");
+			result = readResponse(&connection, response, sizeof(response), TEST_SEND_TIMEOUT_MS / 2);
+			expect(result > 0 && !strcmp(response, "<reply>beside</reply>"), "file", "a waiting file does not hold up the other clients of its worker");
+			close(connection.sock);
+		}
+		//once the timeout has passed the server lets the client go without the rest of the file
+		usleep((TEST_SEND_TIMEOUT_MS + 500) * 1000);
+		while(received < TEST_LARGE_FILE && (result = readPacket(sock, packet, sizeof(packet), TEST_TIMEOUT_MS)) > 0)
+			received += result;
+		expect(received < TEST_LARGE_FILE && readPacket(sock, packet, sizeof(packet), TEST_TIMEOUT_MS) == -1, "file", "a client that takes none of a file for the send timeout is disconnected");
+		close(sock);
+	}
+	expect(stopServer(server) == 0, "file", "server exits normally on SIGTERM");
+  }
+  free(large);
+
+  //without a root directory no file is served
+  server = startServer(port, noOptions);
+  if(expect(server != -1, "file", "server starts without a file root"))
+  {
+	if(expect(openConnection(&connection, port) == 0, "file", "connects"))
+	{
+		sendAll(&connection, "<get-file>hello.txt</get-file>\n");
+		expectResponse(&connection, "file", "<error>file serving disabled</error>", 0);
+		close(connection.sock);
+	}
+	expect(stopServer(server) == 0, "file", "server exits normally on SIGTERM");
+  }
+}
+
+
+/*
+ **************************************************
+ **************************************************
+ */
+void testProxy(int port){
+  char root[TEST_PATH_MAX], backends[TEST_PATH_MAX], command[TEST_PATH_MAX * 2], output[TEST_BUFFER], file[TEST_FILE_SIZE], request[MAX_MESSAGE], expected[MAX_MESSAGE];
+  char path[TEST_PATH_MAX], address[TEST_PATH_MAX + 16];
+  char *backendOptions[] = { "-f", root, NULL }, *proxyOptions[] = { "-P", backends, "-u", path, "-s", NULL };
+  struct sockaddr_in dest;
+  TestConnection_T connection;
+  pid_t first = -1, second = -1, proxyServer = -1;
+  int replies = 0, i = 0, sock = -1;
+
+  //both backends serve the same files, since either may get a request
+  for(i = 0; i < TEST_FILE_SIZE; i++) file[i] = "</error>\n"[i % 9];
+  testPath("proxyroot", root);
+  mkdir(root, 0700);
+  writeTestFile("proxyroot/tags.txt", file, TEST_FILE_SIZE);
+  snprintf(backends, sizeof(backends), "127.0.0.1:%d,127.0.0.1:%d", port + 1, port + 2);
+  testPath("proxy.sock", path);
+  first = startServer(port + 1, backendOptions);
+  second = startServer(port + 2, backendOptions);
+  proxyServer = startServer(port, proxyOptions);
+  if(!expect(first != -1 && second != -1 && proxyServer != -1, "proxy", "proxy and backends start"))
+  {
+	if(first != -1) stopServer(first);
+	if(second != -1) stopServer(second);
+	if(proxyServer != -1) stopServer(proxyServer);
+	return;
+  }
+
+  //replies framed by the proxy the way the clients frame them come back in order
+  if(expect(openConnection(&connection, port) == 0, "proxy", "connects"))
+  {
+	sendAll(&connection, "<echo>via</reply>proxy</echo>\n<get-file>tags.txt</get-file>\n<loadavg/>\n<echo>after</echo>\n<stats/>\n");
+	expectResponse(&connection, "proxy", "<reply>via&lt;/reply>proxy</reply>", 0);
+	expectResponse(&connection, "proxy", "<replyFile length=\"3000\">", 1);
+	expectResponse(&connection, "proxy", "<replyLoadAvg>", 1);
+	expectResponse(&connection, "proxy", "<reply>after</reply>", 0);
+	expectResponse(&connection, "proxy", "<replyStats>", 1);
+	close(connection.sock);
+  }
+
+  //the proxy refuses a seqpacket client a file itself, after the reply before it
+  snprintf(address, sizeof(address), "%s%s", SEQPACKET_PREFIX, path);
+  sock = createSocket(address, 0, &dest);
+  if(expect(sock >= 0, "proxy", "connects to the seqpacket socket"))
+  {
+	send(sock, "<echo>packet</echo>", 19, MSG_NOSIGNAL);
+	send(sock, "<get-file>tags.txt</get-file>", 29, MSG_NOSIGNAL);
+	replies = readPacket(sock, output, sizeof(output), TEST_TIMEOUT_MS);
+	expect(replies > 0 && !strcmp(output, "<reply>packet</reply>"), "proxy", "a seqpacket client gets its forwarded reply");
+	replies = readPacket(sock, output, sizeof(output), TEST_TIMEOUT_MS);
+	expect(replies > 0 && !strcmp(output, "<error>file needs a stream connection</error>"), "proxy", "a seqpacket client is refused files in its turn");
+	close(sock);
+  }
+
+  //the requests of a dead backend go to the one left
+  expect(stopServer(second) == 0, "proxy", "second backend exits normally on SIGTERM");
+  if(expect(openConnection(&connection, port) == 0, "proxy", "connects"))
+  {
+	for(i = 0; i < 16; i++)
+	{
+		sprintf(request, "<echo>failover %d</echo>\n", i);
+		sendAll(&connection, request);
+	}
+	for(i = 0, replies = 0; i < 16; i++)
+	{
+		sprintf(expected, "<reply>failover %d</reply>", i);
+		if(readResponse(&connection, output, sizeof(output), TEST_TIMEOUT_MS) > 0 && !strcmp(output, expected)) replies++;
+	}
+	expect(replies == 16, "proxy", "requests fail over to the backend left");
+	close(connection.sock);
+  }
+
+  //with no backend left every request is answered with an error
+  expect(stopServer(first) == 0, "proxy", "first backend exits normally on SIGTERM");
+  if(expect(openConnection(&connection, port) == 0, "proxy", "connects"))
+  {
+	sendAll(&connection, "<echo>nobody</echo>\n");
+	replies = readResponse(&connection, output, sizeof(output), PROXY_TIMEOUT_MS + TEST_TIMEOUT_MS);
+	expect(replies > 0 && (!strcmp(output, "<error>no backend available</error>") || !strcmp(output, "<error>backend unavailable</error>")),
+		"proxy", "a request with no backend left gets an error");
+	close(connection.sock);
+  }
+  expect(stopServer(proxyServer) == 0, "proxy", "proxy exits normally on SIGTERM");
+
+  //a backend without a port is refused before the proxy starts
+  snprintf(command, sizeof(command), "%s -q -p %d -P 127.0.0.1", serverProgram, port);
+  expect(runProgram(command, output, sizeof(output)) == 1 && strstr(output, "Cannot Forward Requests To") != NULL, "proxy", "refuses a backend without a port");
+}